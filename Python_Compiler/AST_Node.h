@@ -1,323 +1,323 @@
 #ifndef AST_NODE_H
 #define AST_NODE_H
 
+#include <array>
+#include <cstdint>
+#include <iterator>
 #include <vector>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <qDebug>
+#include "AstArena.h"
+#include "Span.h"
+#include "Token.h"
+#include "TokenBuffer.h"
 using namespace std;
 
-// Token types recognized by the lexer
-enum class TokenType {
-    Keyword, Identifier, Number, String, Operator, Delimiter,
-    Assignment, Boolean, Arithmetic, EOFToken, Error, Indent
+// What an AST node is: its class, and its name in nodeKindNames below.
+// Else is the BlockNode of an else branch
+enum class NodeKind : uint8_t {
+    Program, BinaryOp, UnaryOp, Number, String, Identifier, Assign, Elif, If,
+    For, While, FunctionDef, Return, Block, Else, Call, Boolean
 };
 
-// Represents a single token
-struct Token {
-    TokenType type;
-    string value;
-    int line, column;
-    int symbolId = -1;  // Only used for identifiers
+inline constexpr array<string_view, 17> nodeKindNames = {
+    "Program", "BinaryOp", "UnaryOp", "Number", "String", "Identifier", "Assign", "Elif", "If",
+    "For", "While", "FunctionDef", "Return", "Block", "Else", "Call", "Boolean"
 };
 
-// Abstract base class for all AST nodes
+class ASTNode;
+
+// What a node's format gives the tree printers: its text, and where each
+// child's subtree goes, in order. They print a child from its place in
+// here rather than by calling into it, so a tree of any depth prints
+// without recursion. A child that is missing, as in a tree with errors,
+// is left out
+class TreeFormat {
+public:
+    TreeFormat& operator+=(std::string_view text) {
+        if (items.empty() || items.back().node) items.push_back({nullptr, {}, false});
+        items.back().text += text;
+        return *this;
+    }
+
+    void child(const ASTNode* node, std::string prefix, bool isLast) {
+        if (node) items.push_back({node, move(prefix), isLast});
+    }
+
+    // Prints the tree under root, each node by format(node, prefix, isLast, out)
+    template <typename Format>
+    static std::string print(const ASTNode* root, const std::string& prefix, bool isLast, Format format);
+
+private:
+    struct Item {
+        const ASTNode* node;  // null: text to print as is
+        std::string text;     // otherwise the node's prefix
+        bool isLast;
+    };
+    std::vector<Item> items;
+};
+
+// Base class for all AST nodes. Nodes live in the AstArena of their parse
+// and are never destroyed individually; children is an array in the same
+// arena. There are no virtual functions: kind says which class a node is,
+// and code that depends on it switches on kind or uses visitNode() below.
+//
+// A node does not copy its token. token is its index in the TokenBuffer the
+// parse read (Ast::tokens), where its text and location are looked up
 class ASTNode {
 public:
-    Token token;
-    std::vector<std::unique_ptr<ASTNode>> children;
+    static constexpr uint32_t noToken = ~uint32_t(0);  // nodes without one (Program)
+
+    uint32_t token;
+    NodeKind kind;
+    Span<ASTNode*> children;
 
-    ASTNode(const Token& t) : token(t) {}
-    virtual ~ASTNode() = default;
+    ASTNode(NodeKind kind, uint32_t token, Span<ASTNode*> children = {})
+        : token(token), kind(kind), children(children) {}
 
-    virtual std::string getNodeType() const = 0;
+    std::string_view getNodeType() const { return nodeKindNames[size_t(kind)]; }
 
-    virtual std::string toString(int indent = 0, const std::string& prefix = "", bool isLast = true) const {
-        std::string result;
-        result += prefix + (isLast ? "└──" : "├──");
-        result += getNodeType() + " [" + token.value + "] (line " + std::to_string(token.line) + ")\n";
+    // Tree printers, given the tokens of the parse. Each node class formats
+    // itself into a TreeFormat with formatString and formatParseTree; these
+    // pick the class's version by kind
+    std::string toString(const TokenBuffer& tokens, const std::string& prefix = "", bool isLast = true) const;
+    std::string toParseTreeString(const TokenBuffer& tokens, const std::string& prefix = "", bool isLast = true) const;
+
+    // The formats of nodes that do not have their own
+    void formatString(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──");
+        out += getNodeType();
+        out += " [" + std::string(tokens.value(token)) + "] (line " + std::to_string(tokens.line(token)) + ")\n";
 
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
         for (size_t i = 0; i < children.size(); ++i) {
-            result += children[i]->toString(indent + 1, childPrefix, i == children.size() - 1);
+            out.child(children[i], childPrefix, i == children.size() - 1);
         }
-
-        return result;
     }
 
-    virtual std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const {
-        std::string result = prefix + (isLast ? "└──" : "├──") + getNodeType();
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──");
+        out += getNodeType();
 
         // Only show token value if it's not empty (for nodes that use it)
-        if (!token.value.empty() && token.value != getNodeType()) {
-            result += " [" + token.value + "]";
+        if (!tokens.value(token).empty() && tokens.value(token) != getNodeType()) {
+            out += " [" + std::string(tokens.value(token)) + "]";
         }
-        result += "\n";
+        out += "\n";
 
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
         for (size_t i = 0; i < children.size(); ++i) {
-            result += children[i]->toParseTreeString(indent + 1, childPrefix, i == children.size() - 1);
+            out.child(children[i], childPrefix, i == children.size() - 1);
         }
-
-        return result;
     }
-
-    void addChild(std::unique_ptr<ASTNode> child) {
-        children.push_back(std::move(child));
-    }
-
-    Token getToken(){
-        return token;
-    }
-
-    virtual ASTNode* getLeft() const { return nullptr; }
-    virtual ASTNode* getRight() const { return nullptr; }
-    virtual ASTNode* getOperand() const { return nullptr; }
-    virtual Token getOp() const { return Token{TokenType::Error, "", 0, 0}; }
 };
 
 // Program root node
 class ProgramNode : public ASTNode {
 public:
-    ProgramNode() : ASTNode({TokenType::EOFToken, "Program", 1, 1}) {}
+    ProgramNode() : ASTNode(NodeKind::Program, noToken) {}
 
-    std::string getNodeType() const override { return "Program"; }
 
-    std::string toString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + getNodeType() + "\n";
+    void formatString(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + std::string(getNodeType()) + "\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
         for (size_t i = 0; i < children.size(); ++i) {
-            result += children[i]->toString(indent + 1, childPrefix, i == children.size() - 1);
+            out.child(children[i], childPrefix, i == children.size() - 1);
         }
-        return result;
     }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "Program\n";
+    void formatParseTree(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "Program\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
         for (size_t i = 0; i < children.size(); ++i) {
-            result += children[i]->toParseTreeString(indent + 1, childPrefix, i == children.size() - 1);
+            out.child(children[i], childPrefix, i == children.size() - 1);
         }
-        return result;
     }
 };
 
 // Expression nodes
 class BinaryOpNode : public ASTNode {
 public:
-    BinaryOpNode(const Token& op, std::unique_ptr<ASTNode> left, std::unique_ptr<ASTNode> right)
-        : ASTNode(op) {
-        addChild(std::move(left));
-        addChild(std::move(right));
-    }
+    BinaryOpNode(AstArena& arena, uint32_t op, ASTNode* left, ASTNode* right)
+        : ASTNode(NodeKind::BinaryOp, op, arena.copy({left, right})) {}
 
-    std::string getNodeType() const override { return "BinaryOp"; }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "BinaryOp\n";
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "BinaryOp\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         // Left child
-        result += children[0]->toParseTreeString(indent + 1, childPrefix, false);
+        out.child(children[0], childPrefix, false);
 
         // Operator
-        result += childPrefix + "├── " + token.value + "\n";
+        out += childPrefix + "├── " + std::string(tokens.value(token)) + "\n";
 
         // Right child
-        result += children[1]->toParseTreeString(indent + 1, childPrefix, true);
-
-        return result;
+        out.child(children[1], childPrefix, true);
     }
 
-    ASTNode* getLeft() const override { return children.size() > 0 ? children[0].get() : nullptr; }
-    ASTNode* getRight() const override { return children.size() > 1 ? children[1].get() : nullptr; }
-    Token getOp() const override { return token; }
+    ASTNode* getLeft() const { return children.size() > 0 ? children[0] : nullptr; }
+    ASTNode* getRight() const { return children.size() > 1 ? children[1] : nullptr; }
+    uint32_t getOp() const { return token; }
 };
 
 class UnaryOpNode : public ASTNode {
 public:
-    UnaryOpNode(const Token& op, std::unique_ptr<ASTNode> operand)
-        : ASTNode(op) {
-        addChild(std::move(operand));
-    }
+    UnaryOpNode(AstArena& arena, uint32_t op, ASTNode* operand)
+        : ASTNode(NodeKind::UnaryOp, op, arena.copy({operand})) {}
 
-    std::string getNodeType() const override { return "UnaryOp"; }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "UnaryOp [" + token.value + "]\n";
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "UnaryOp [" + std::string(tokens.value(token)) + "]\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
-        result += children[0]->toParseTreeString(indent + 1, childPrefix, true);
-        return result;
+        out.child(children[0], childPrefix, true);
     }
 
-    ASTNode* getOperand() const override { return children.size() > 0 ? children[0].get() : nullptr; }
-    Token getOp() const override { return token; }
+    ASTNode* getOperand() const { return children.size() > 0 ? children[0] : nullptr; }
+    uint32_t getOp() const { return token; }
 };
 
 class NumberNode : public ASTNode {
 public:
-    double value;
-    string type;
-    NumberNode(const Token& numToken)
-        : ASTNode(numToken), value(std::stod(numToken.value)) {
-        if(numToken.value.find(".")  == string::npos){
-            type = "int";
-        }
-        else type = "float";
-    }
-
-    std::string getNodeType() const override { return "Number"; }
+    Number number;  // as the lexer decoded the literal
+    NumberNode(uint32_t numToken, Number number)
+        : ASTNode(NodeKind::Number, numToken), number(number) {}
 
-    double getValue(){
-        return value;
+    double getValue() const {
+        return number.toDouble();
     }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        return prefix + (isLast ? "└──" : "├──") + "Number [" + token.value + "]\n";
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "Number [" + std::string(tokens.value(token)) + "]\n";
     }
 
-    string getValueType() const {
-        return type;
+    string_view getValueType() const {
+        return number.isInteger() ? "int" : "float";
     }
 };
 
 class StringNode : public ASTNode {
 public:
-    StringNode(const Token& strToken)
-        : ASTNode(strToken) {}
+    StringNode(uint32_t strToken)
+        : ASTNode(NodeKind::String, strToken) {}
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        return prefix + (isLast ? "└──" : "├──") + "String [" + token.value + "]\n";
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "String [" + std::string(tokens.value(token)) + "]\n";
     }
 
-    std::string getNodeType() const override { return "String"; }
 };
 
 class IdentifierNode : public ASTNode {
 public:
-    IdentifierNode(const Token& idToken)
-        : ASTNode(idToken) {}
+    IdentifierNode(uint32_t idToken)
+        : ASTNode(NodeKind::Identifier, idToken) {}
 
-    std::string getNodeType() const override { return "Identifier"; }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        return prefix + (isLast ? "└──" : "├──") + "Identifier [" + token.value + "]\n";
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "Identifier [" + std::string(tokens.value(token)) + "]\n";
     }
 };
 
 // Statement nodes
 class AssignNode : public ASTNode {
 public:
-    AssignNode(const Token& assignToken, std::unique_ptr<ASTNode> target, std::unique_ptr<ASTNode> value)
-        : ASTNode(assignToken) {
-        addChild(std::move(target));
-        addChild(std::move(value));
-    }
+    AssignNode(AstArena& arena, uint32_t assignToken, ASTNode* target, ASTNode* value)
+        : ASTNode(NodeKind::Assign, assignToken, arena.copy({target, value})) {}
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "Assignment\n";
+    void formatParseTree(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "Assignment\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         // Target
-        result += children[0]->toParseTreeString(indent + 1, childPrefix, false);
+        out.child(children[0], childPrefix, false);
 
         // Operator
-        result += childPrefix + "├── Operator [=]\n";
+        out += childPrefix + "├── Operator [=]\n";
 
         // Value
-        result += children[1]->toParseTreeString(indent + 1, childPrefix, true);
-
-        return result;
+        out.child(children[1], childPrefix, true);
     }
 
-    std::string getNodeType() const override { return "Assign"; }
 };
 
 // New node type for elif conditions
 class ElifNode : public ASTNode {
 public:
-    ElifNode(const Token& token, std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> thenBranch)
-        : ASTNode(token) {
-        addChild(std::move(condition));
-        addChild(std::move(thenBranch));
-    }
+    ElifNode(AstArena& arena, uint32_t token, ASTNode* condition, ASTNode* thenBranch)
+        : ASTNode(NodeKind::Elif, token, arena.copy({condition, thenBranch})) {}
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "Elif\n";
+    void formatParseTree(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "Elif\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         // Condition
-        result += children[0]->toParseTreeString(indent + 1, childPrefix, false);
+        out.child(children[0], childPrefix, false);
 
         // Then branch
-        result += children[1]->toParseTreeString(indent + 1, childPrefix, true);
-
-        return result;
+        out.child(children[1], childPrefix, true);
     }
 
-    std::string getNodeType() const override { return "Elif"; }
 
-    ASTNode* getCondition() const { return children[0].get(); }
-    ASTNode* getThenBranch() const { return children[1].get(); }
+    ASTNode* getCondition() const { return children[0]; }
+    ASTNode* getThenBranch() const { return children[1]; }
 };
 
 class IfNode : public ASTNode {
 public:
-    IfNode(const Token& token, std::unique_ptr<ASTNode> condition,
-           std::unique_ptr<ASTNode> thenBranch,
-           std::unique_ptr<ASTNode> elseBranch = nullptr,
-           std::vector<std::unique_ptr<ElifNode>> elifBranches = {})
-        : ASTNode(token) {
-        addChild(std::move(condition));   // index 0
-        addChild(std::move(thenBranch));  // index 1
+    IfNode(AstArena& arena, uint32_t token, ASTNode* condition,
+           ASTNode* thenBranch,
+           ASTNode* elseBranch = nullptr,
+           const std::vector<ElifNode*>& elifBranches = {})
+        : ASTNode(NodeKind::If, token) {
+        std::vector<ASTNode*> branches;
+        branches.push_back(condition);   // index 0
+        branches.push_back(thenBranch);  // index 1
         // Add elif branches as children after else
-        for (auto& elif : elifBranches) {
-            addChild(std::move(elif));
-        }
-        if (elseBranch) addChild(std::move(elseBranch)); // last index (optional)
-
-
+        branches.insert(branches.end(), elifBranches.begin(), elifBranches.end());
+        if (elseBranch) branches.push_back(elseBranch); // last index (optional)
+        children = arena.copy(branches);
     }
 
-    std::string getNodeType() const override { return "If"; }
 
-    ASTNode* getCondition() const { return children[0].get(); }
-    ASTNode* getThenBranch() const { return children[1].get(); }
+    ASTNode* getCondition() const { return children[0]; }
+    ASTNode* getThenBranch() const { return children[1]; }
     ASTNode* getElseBranch() const {
         // Else branch is at index 2 if it exists, but after that come elif branches
         int idx= children.size() -1;
-        return children.size() > 2 && children[idx]->getNodeType() == "Else" ? children[idx].get() : nullptr;
+        return children.size() > 2 && children[idx]->kind == NodeKind::Else ? children[idx] : nullptr;
     }
 
     std::vector<ElifNode*> getElifBranches() const {
         std::vector<ElifNode*> elifs;
         for (size_t i = 2; i < children.size(); ++i) {
-            if (children[i]->getNodeType() == "Elif") {
-                elifs.push_back(static_cast<ElifNode*>(children[i].get()));
+            if (children[i]->kind == NodeKind::Elif) {
+                elifs.push_back(static_cast<ElifNode*>(children[i]));
             }
         }
         return elifs;
     }
 
 
-    std::string toString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + getNodeType() + "\n";
+    void formatString(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + std::string(getNodeType()) + "\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         // Print condition
-        result += children[0]->toString(indent + 1, childPrefix, false);
+        out.child(children[0], childPrefix, false);
 
         // Print then branch
-        result += children[1]->toString(indent + 1, childPrefix, children.size() == 2);
+        out.child(children[1], childPrefix, children.size() == 2);
 
         // Elif branches
         size_t idx = 2;
         for (; idx < children.size(); ++idx) {
-            if (children[idx]->getNodeType() == "Elif") {
-                result += childPrefix + "├──" + children[idx]->getNodeType() + ":";
-                result += children[idx]->toString(indent + 1, childPrefix + "│    ",
-                                                  // if last among elif and no else
-                                                  idx + 1 == children.size());
+            if (children[idx]->kind == NodeKind::Elif) {
+                out += childPrefix + "├──" + std::string(children[idx]->getNodeType()) + ":";
+                out.child(children[idx], childPrefix + "│    ",
+                          // if last among elif and no else
+                          idx + 1 == children.size());
             } else {
                 break;
             }
@@ -325,35 +325,33 @@ public:
 
         // Else branch (if exists)
         if (idx < children.size()) {
-            result += childPrefix + "├──" + children[idx]->getNodeType() + ":";
-            result += children[idx]->toString(indent + 1, childPrefix + "│    ", true);
+            out += childPrefix + "├──" + std::string(children[idx]->getNodeType()) + ":";
+            out.child(children[idx], childPrefix + "│    ", true);
         }
-
-        return result;
     }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "If\n";
+    void formatParseTree(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "If\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         // Condition
-        result += children[0]->toParseTreeString(indent + 1, childPrefix, false);
+        out.child(children[0], childPrefix, false);
 
         // Then branch
         if(children.size() <= 2){
-            result += childPrefix + "└── Then\n";
-            result += children[1]->toParseTreeString(indent + 1, childPrefix + "    ", true);
+            out += childPrefix + "└── Then\n";
+            out.child(children[1], childPrefix + "    ", true);
         }
         else{
-            result += childPrefix + "├── Then\n";
-            result += children[1]->toParseTreeString(indent + 1, childPrefix + "│    ", true);
+            out += childPrefix + "├── Then\n";
+            out.child(children[1], childPrefix + "│    ", true);
         }
 
         // Elif branches
         size_t idx = 2;
         for (; idx < children.size(); ++idx) {
-            if (children[idx]->getNodeType() == "Elif") {
-                result += children[idx]->toParseTreeString(indent + 1, childPrefix, idx + 1 == children.size());
+            if (children[idx]->kind == NodeKind::Elif) {
+                out.child(children[idx], childPrefix, idx + 1 == children.size());
             } else {
                 break;
             }
@@ -361,215 +359,256 @@ public:
 
         // Else branch (if exists)
         if (idx < children.size()) {
-            result += childPrefix + "└── Else\n";
-            result += children[idx]->toParseTreeString(indent + 1, childPrefix + "    ", true);
+            out += childPrefix + "└── Else\n";
+            out.child(children[idx], childPrefix + "    ", true);
         }
-
-        return result;
     }
 };
 
 class ForNode : public ASTNode {
 public:
-    ForNode(const Token& forToken,
-            std::unique_ptr<ASTNode> var,
-            std::unique_ptr<ASTNode> iterable,
-            std::unique_ptr<ASTNode> body)
-        : ASTNode(forToken) {
-        addChild(std::move(var));       // index 0 - loop variable
-        addChild(std::move(iterable));  // index 1 - iterable expression
-        addChild(std::move(body));      // index 2 - loop body
-    }
+    // Children: 0 loop variable, 1 iterable expression, 2 loop body
+    ForNode(AstArena& arena, uint32_t forToken, ASTNode* var, ASTNode* iterable, ASTNode* body)
+        : ASTNode(NodeKind::For, forToken, arena.copy({var, iterable, body})) {}
 
-    std::string getNodeType() const override { return "For"; }
 
-    ASTNode* getVariable() const { return children[0].get(); }
-    ASTNode* getIterable() const { return children[1].get(); }
-    ASTNode* getBody() const { return children[2].get(); }
+    ASTNode* getVariable() const { return children[0]; }
+    ASTNode* getIterable() const { return children[1]; }
+    ASTNode* getBody() const { return children[2]; }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "For\n";
+    void formatParseTree(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "For\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         // Variable
-        result += childPrefix + "├── Variable\n";
-        result += children[0]->toParseTreeString(indent + 1, childPrefix + "│    ", false);
+        out += childPrefix + "├── Variable\n";
+        out.child(children[0], childPrefix + "│    ", false);
 
         // Iterable
-        result += childPrefix + "├── Iterable\n";
-        result += children[1]->toParseTreeString(indent + 1, childPrefix + "│    ", false);
+        out += childPrefix + "├── Iterable\n";
+        out.child(children[1], childPrefix + "│    ", false);
 
         // Body
-        result += childPrefix + "└── Body\n";
-        result += children[2]->toParseTreeString(indent + 1, childPrefix + "    ", true);
-
-        return result;
+        out += childPrefix + "└── Body\n";
+        out.child(children[2], childPrefix + "    ", true);
     }
 };
 
 class WhileNode : public ASTNode {
 public:
-    WhileNode(const Token& whileToken, std::unique_ptr<ASTNode> condition, std::unique_ptr<ASTNode> body)
-        : ASTNode(whileToken) {
-        addChild(std::move(condition));
-        addChild(std::move(body));
-    }
+    WhileNode(AstArena& arena, uint32_t whileToken, ASTNode* condition, ASTNode* body)
+        : ASTNode(NodeKind::While, whileToken, arena.copy({condition, body})) {}
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "While\n";
+    void formatParseTree(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "While\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         // Condition
-        result += children[0]->toParseTreeString(indent + 1, childPrefix, false);
+        out.child(children[0], childPrefix, false);
 
         // Body
-        result += childPrefix + "└── Body\n";
-        result += children[1]->toParseTreeString(indent + 1, childPrefix + "    ", true);
-
-        return result;
+        out += childPrefix + "└── Body\n";
+        out.child(children[1], childPrefix + "    ", true);
     }
 
-    std::string getNodeType() const override { return "While"; }
 };
 
+class BodyParser;
+
 class FunctionDefNode : public ASTNode {
 public:
-    std::vector<std::string> paramNames;
+    Span<uint32_t> params;  // the parameter names' tokens
+
+    // Set when a lazy parse skipped the body (see BodyParser): children[1]
+    // is null until getBody() parses it from bodyToken, in scope
+    BodyParser* bodies = nullptr;
+    uint32_t bodyToken = noToken;
+    int scope = -1;
 
-    FunctionDefNode(const Token& defToken, const std::string& name,
-                    std::vector<std::string> params, std::unique_ptr<ASTNode> body)
-        : ASTNode(defToken), paramNames(std::move(params)) {
-        addChild(std::make_unique<IdentifierNode>(Token{TokenType::Identifier, name, defToken.line, defToken.column}));
-        addChild(std::move(body));
+    FunctionDefNode(AstArena& arena, uint32_t defToken, uint32_t nameToken,
+                    const std::vector<uint32_t>& params, ASTNode* body)
+        : ASTNode(NodeKind::FunctionDef, defToken), params(arena.copy(params)) {
+        children = arena.copy({static_cast<ASTNode*>(arena.make<IdentifierNode>(nameToken)), body});
     }
 
-    std::string getNodeType() const override { return "FunctionDef"; }
+    // The body, parsed now if it was skipped and kept as children[1]
+    ASTNode* getBody() const { return children[1] || !bodies ? children[1] : parseBody(); }
 
-    std::string toString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──");
-        result += getNodeType() + " " + children[0]->token.value + "\n";
+    void formatString(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──");
+        out += std::string(getNodeType()) + " " + std::string(tokens.value(children[0]->token)) + "\n";
 
         std::string paramPrefix = prefix + (isLast ? "    " : "│    ");
-        result += paramPrefix + "├── Parameters: ";
-        for (size_t i = 0; i < paramNames.size(); ++i) {
-            result += paramNames[i];
-            if (i < paramNames.size() - 1) result += ", ";
+        out += paramPrefix + "├── Parameters: ";
+        for (size_t i = 0; i < params.size(); ++i) {
+            out += tokens.value(params[i]);
+            if (i < params.size() - 1) out += ", ";
         }
-        result += "\n";
+        out += "\n";
 
-        result += children[1]->toString(indent + 1, paramPrefix, true);
-        return result;
+        out.child(getBody(), paramPrefix, true);
     }
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "FunctionDef [" + children[0]->token.value + "]\n";
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "FunctionDef [" + std::string(tokens.value(children[0]->token)) + "]\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         // Parameters
-        result += childPrefix + "├── Parameters\n";
+        out += childPrefix + "├── Parameters\n";
         std::string paramPrefix = childPrefix + "│    ";
-        for (size_t i = 0; i < paramNames.size(); ++i) {
-            bool lastParam = (i == paramNames.size() - 1);
-            result += paramPrefix + (lastParam ? "└──" : "├──") + "Parameter [" + paramNames[i] + "]\n";
+        for (size_t i = 0; i < params.size(); ++i) {
+            bool lastParam = (i == params.size() - 1);
+            out += paramPrefix + (lastParam ? "└──" : "├──") + "Parameter [" + std::string(tokens.value(params[i])) + "]\n";
         }
 
         // Body
-        result += childPrefix + "└── Body\n";
-        result += children[1]->toParseTreeString(indent + 1, childPrefix + "    ", true);
-
-        return result;
+        out += childPrefix + "└── Body\n";
+        out.child(getBody(), childPrefix + "    ", true);
     }
+
+private:
+    ASTNode* parseBody() const;  // in parser.cpp, with the parser
 };
 
 class ReturnNode : public ASTNode {
 public:
-    ReturnNode(const Token& returnToken, std::unique_ptr<ASTNode> value = nullptr)
-        : ASTNode(returnToken) {
-        if (value) {
-            addChild(std::move(value));
-        }
-    }
+    ReturnNode(AstArena& arena, uint32_t returnToken, ASTNode* value = nullptr)
+        : ASTNode(NodeKind::Return, returnToken, value ? arena.copy({value}) : Span<ASTNode*>()) {}
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "Return\n";
+    void formatParseTree(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "Return\n";
         if (!children.empty()) {
             std::string childPrefix = prefix + (isLast ? "    " : "│    ");
-            result += children[0]->toParseTreeString(indent + 1, childPrefix, true);
+            out.child(children[0], childPrefix, true);
         }
-        return result;
     }
 
-    std::string getNodeType() const override { return "Return"; }
 };
 
 class BlockNode : public ASTNode {
 public:
-    BlockNode(const Token& blockToken)
-        : ASTNode(blockToken) {}
+    // isElse: the block of an else branch, an Else node
+    BlockNode(uint32_t blockToken, bool isElse = false)
+        : ASTNode(isElse ? NodeKind::Else : NodeKind::Block, blockToken) {}
 
-    std::string getNodeType() const override {
-        if(token.value == "else")
-            return "Else";
-        else
-            return "Block"; }
-
-    std::string toString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + getNodeType() + "\n";
+    void formatString(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + std::string(getNodeType()) + "\n";
         std::string childPrefix = prefix + (isLast ? "    " : "  ");
         for (size_t i = 0; i < children.size(); ++i) {
-            result += children[i]->toString(indent + 1, childPrefix, i == children.size() - 1);
+            out.child(children[i], childPrefix, i == children.size() - 1);
         }
-        return result;
     }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + getNodeType() + "\n";
+    void formatParseTree(const TokenBuffer&, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + std::string(getNodeType()) + "\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
         for (size_t i = 0; i < children.size(); ++i) {
-            result += children[i]->toParseTreeString(indent + 1, childPrefix, i == children.size() - 1);
+            out.child(children[i], childPrefix, i == children.size() - 1);
         }
-        return result;
     }
 };
 
 class CallNode : public ASTNode {
 public:
-    CallNode(const Token& callToken, std::unique_ptr<ASTNode> func,
-             std::vector<std::unique_ptr<ASTNode>> args)
-        : ASTNode(callToken) {
-        addChild(std::move(func));
-        for (auto& arg : args) {
-            addChild(std::move(arg));
-        }
+    CallNode(AstArena& arena, uint32_t callToken, ASTNode* func,
+             const std::vector<ASTNode*>& args)
+        : ASTNode(NodeKind::Call, callToken) {
+        std::vector<ASTNode*> items{func};
+        items.insert(items.end(), args.begin(), args.end());
+        children = arena.copy(items);
     }
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        std::string result = prefix + (isLast ? "└──" : "├──") + "Call: " + children[0]->token.value + "\n";
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "Call: " + std::string(tokens.value(children[0]->token)) + "\n";
         std::string childPrefix = prefix + (isLast ? "    " : "│    ");
 
         if (children.size() > 1) {
-            result += childPrefix + "├── (\n";
-            result += childPrefix + "│    ├── Arguments\n";
+            out += childPrefix + "├── (\n";
+            out += childPrefix + "│    ├── Arguments\n";
             std::string argPrefix = childPrefix + "│    │    ";
             for (size_t i = 1; i < children.size(); ++i) {
-                result += children[i]->toParseTreeString(indent + 1, argPrefix, i == children.size() - 1);
+                out.child(children[i], argPrefix, i == children.size() - 1);
             }
-            result += childPrefix + "└── )\n";
+            out += childPrefix + "└── )\n";
         }
-
-        return result;
     }
 
-    std::string getNodeType() const override { return "Call"; }
 };
 
 class BooleanNode : public ASTNode {
 public:
-    BooleanNode(const Token& boolToken) : ASTNode(boolToken) {}
-    string getNodeType() const override { return "Boolean"; }
+    BooleanNode(uint32_t boolToken) : ASTNode(NodeKind::Boolean, boolToken) {}
 
-    std::string toParseTreeString(int indent = 0, const std::string& prefix = "", bool isLast = true) const override {
-        return prefix + (isLast ? "└──" : "├──") + "Boolean [" + token.value + "]\n";
+    void formatParseTree(const TokenBuffer& tokens, const std::string& prefix, bool isLast, TreeFormat& out) const {
+        out += prefix + (isLast ? "└──" : "├──") + "Boolean [" + std::string(tokens.value(token)) + "]\n";
     }
 };
 
+// Calls f with node cast to its class, as named by node->kind
+template <typename F>
+decltype(auto) visitNode(const ASTNode* node, F&& f) {
+    switch (node->kind) {
+    case NodeKind::Program: return f(static_cast<const ProgramNode*>(node));
+    case NodeKind::BinaryOp: return f(static_cast<const BinaryOpNode*>(node));
+    case NodeKind::UnaryOp: return f(static_cast<const UnaryOpNode*>(node));
+    case NodeKind::Number: return f(static_cast<const NumberNode*>(node));
+    case NodeKind::String: return f(static_cast<const StringNode*>(node));
+    case NodeKind::Identifier: return f(static_cast<const IdentifierNode*>(node));
+    case NodeKind::Assign: return f(static_cast<const AssignNode*>(node));
+    case NodeKind::Elif: return f(static_cast<const ElifNode*>(node));
+    case NodeKind::If: return f(static_cast<const IfNode*>(node));
+    case NodeKind::For: return f(static_cast<const ForNode*>(node));
+    case NodeKind::While: return f(static_cast<const WhileNode*>(node));
+    case NodeKind::FunctionDef: return f(static_cast<const FunctionDefNode*>(node));
+    case NodeKind::Return: return f(static_cast<const ReturnNode*>(node));
+    case NodeKind::Block:
+    case NodeKind::Else: return f(static_cast<const BlockNode*>(node));
+    case NodeKind::Call: return f(static_cast<const CallNode*>(node));
+    case NodeKind::Boolean: break;
+    }
+    return f(static_cast<const BooleanNode*>(node));
+}
+
+template <typename Format>
+std::string TreeFormat::print(const ASTNode* root, const std::string& prefix, bool isLast, Format format) {
+    std::string result;
+    std::vector<Item> pending{{root, prefix, isLast}};  // in reverse order
+    TreeFormat out;
+    while (!pending.empty()) {
+        Item item = move(pending.back());
+        pending.pop_back();
+        if (!item.node) {
+            result += item.text;
+            continue;
+        }
+        visitNode(item.node, [&](const auto* node) { format(node, item.text, item.isLast, out); });
+        move(out.items.rbegin(), out.items.rend(), back_inserter(pending));
+        out.items.clear();
+    }
+    return result;
+}
+
+inline std::string ASTNode::toString(const TokenBuffer& tokens, const std::string& prefix, bool isLast) const {
+    return TreeFormat::print(this, prefix, isLast, [&](const auto* node, const std::string& prefix, bool isLast, TreeFormat& out) {
+        node->formatString(tokens, prefix, isLast, out);
+    });
+}
+
+inline std::string ASTNode::toParseTreeString(const TokenBuffer& tokens, const std::string& prefix, bool isLast) const {
+    return TreeFormat::print(this, prefix, isLast, [&](const auto* node, const std::string& prefix, bool isLast, TreeFormat& out) {
+        node->formatParseTree(tokens, prefix, isLast, out);
+    });
+}
+
+// A parsed program. Every node of the tree is in arena, so root is valid
+// for as long as the Ast is kept, and dropping it frees the whole tree at
+// once. tokens are the ones the parse read, which the nodes index. After a
+// lazy parse, bodies parses the function bodies it skipped, into an arena
+// of its own
+struct Ast {
+    unique_ptr<AstArena> arena;
+    shared_ptr<const TokenBuffer> tokens;
+    ProgramNode* root = nullptr;
+    shared_ptr<BodyParser> bodies = nullptr;
+};
+
 #endif // AST_NODE_H
@@ -0,0 +1,122 @@
+#ifndef ASTARENA_H
+#define ASTARENA_H
+
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Span.h"
+
+using namespace std;
+
+// Bump allocator owning every node of one parse. Nodes and their child
+// arrays are carved out of large chunks and never destroyed one by one;
+// the arena frees whole chunks, so dropping a tree costs one free per chunk
+// instead of a destructor call per node. Only trivially destructible types
+// can be put in it.
+//
+// Chunks start at 64 KiB and double up to 2 MiB. Those are allocated
+// 2 MiB-aligned, so the OS can back each with a single huge page.
+class AstArena {
+public:
+    AstArena() = default;
+    AstArena(const AstArena&) = delete;
+    AstArena& operator=(const AstArena&) = delete;
+
+    ~AstArena() {
+        for (const Chunk& chunk : chunks) {
+            ::operator delete(chunk.memory, chunk.alignment);
+        }
+    }
+
+    // Constructs a T in the arena. Types that take the arena as their first
+    // constructor argument (nodes with child arrays) are given this one
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(is_trivially_destructible<T>::value, "arena objects are never destroyed");
+        void* memory = allocate(sizeof(T), alignof(T));
+        if constexpr (is_constructible<T, AstArena&, Args...>::value) {
+            return new (memory) T(*this, forward<Args>(args)...);
+        } else {
+            return new (memory) T(forward<Args>(args)...);
+        }
+    }
+
+    // A copy of items in the arena
+    template <typename T>
+    Span<T> copy(const T* items, size_t count) {
+        static_assert(is_trivially_copyable<T>::value, "arena arrays are copied bytewise");
+        if (count == 0) return {};
+        T* array = static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+        memcpy(array, items, count * sizeof(T));
+        return Span<T>(array, count);
+    }
+
+    template <typename T>
+    Span<T> copy(const vector<T>& items) { return copy(items.data(), items.size()); }
+
+    template <typename T>
+    Span<T> copy(initializer_list<T> items) { return copy(items.begin(), items.size()); }
+
+    void* allocate(size_t size, size_t alignment) {
+        size_t start = (used + alignment - 1) & ~(alignment - 1);
+        if (chunks.empty() || start + size > chunks.back().size) {
+            grow(size + alignment);
+            start = 0;
+        }
+        used = start + size;
+        return static_cast<char*>(chunks.back().memory) + start;
+    }
+
+    // Takes over the chunks of other, e.g. an arena a subtree was built in
+    // on another thread, so that they are freed with this one's
+    void adopt(AstArena& other) {
+        if (chunks.empty()) used = other.used;
+        // New allocations keep going into this arena's last chunk
+        chunks.insert(chunks.empty() ? chunks.end() : chunks.end() - 1, other.chunks.begin(), other.chunks.end());
+        other.chunks.clear();
+        other.used = 0;
+    }
+
+    // Ends the life of everything made in it, keeping the first chunk to be
+    // filled again
+    void reset() {
+        if (chunks.empty()) return;
+        for (size_t i = 1; i < chunks.size(); ++i) ::operator delete(chunks[i].memory, chunks[i].alignment);
+        chunks.resize(1);
+        used = 0;
+    }
+
+    // Bytes reserved from the system
+    size_t memoryUsage() const {
+        size_t total = 0;
+        for (const Chunk& chunk : chunks) total += chunk.size;
+        return total;
+    }
+
+private:
+    static constexpr size_t firstChunk = size_t(64) << 10;
+    static constexpr size_t hugePage = size_t(2) << 20;
+
+    struct Chunk {
+        void* memory;
+        size_t size;
+        align_val_t alignment;
+    };
+
+    vector<Chunk> chunks;
+    size_t used = 0;  // bytes handed out from chunks.back()
+
+    void grow(size_t atLeast) {
+        size_t size = chunks.empty() ? firstChunk : min(chunks.back().size * 2, hugePage);
+        while (size < atLeast) size *= 2;
+        align_val_t alignment = align_val_t(size >= hugePage ? hugePage : alignof(max_align_t));
+        chunks.push_back({::operator new(size, alignment), size, alignment});
+        used = 0;
+    }
+};
+
+#endif // ASTARENA_H
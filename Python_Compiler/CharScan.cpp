@@ -0,0 +1,226 @@
+#include "CharScan.h"
+#include <atomic>
+#include <cstring>
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define CHARSCAN_X86 1
+#include <immintrin.h>
+#endif
+
+namespace charscan {
+namespace {
+
+// Each scan is described by a trait: which bytes continue the run (scalar),
+// and a vector classifier whose set lanes are bytes that stop it.
+
+struct IdentifierScan {
+    static bool stops(char c) { return !isIdentChar(c); }
+};
+
+struct DigitScan {
+    static bool stops(char c) { return !isDigit(c); }
+};
+
+struct BlankScan {
+    static bool stops(char c) { return !isBlank(c); }
+};
+
+struct QuoteOrNewlineScan {
+    static bool stops(char c) { return c == '"' || c == '\n'; }
+};
+
+template <class Scan>
+const char* scanScalar(const char* p, const char* end) {
+    while (p < end && !Scan::stops(*p)) ++p;
+    return p;
+}
+
+#ifdef CHARSCAN_X86
+
+// ---- SSE2 (always present on x86-64) ----
+
+// Lanes where lo <= x <= hi, comparing bytes as unsigned
+inline __m128i inRange16(__m128i x, char lo, char hi) {
+    __m128i shifted = _mm_sub_epi8(x, _mm_set1_epi8(lo));
+    return _mm_cmpeq_epi8(_mm_min_epu8(shifted, _mm_set1_epi8(char(hi - lo))), shifted);
+}
+
+inline __m128i identChars16(__m128i v) {
+    __m128i letter = inRange16(_mm_or_si128(v, _mm_set1_epi8(0x20)), 'a', 'z');
+    __m128i digit = inRange16(v, '0', '9');
+    __m128i underscore = _mm_cmpeq_epi8(v, _mm_set1_epi8('_'));
+    return _mm_or_si128(_mm_or_si128(letter, digit), underscore);
+}
+
+inline __m128i blanks16(__m128i v) {
+    __m128i space = _mm_cmpeq_epi8(v, _mm_set1_epi8(' '));
+    __m128i control = _mm_andnot_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('\n')), inRange16(v, '\t', '\r'));
+    return _mm_or_si128(space, control);
+}
+
+// Bit i set when byte i stops the scan
+template <class Scan> unsigned stopMask16(__m128i v);
+
+template <> unsigned stopMask16<IdentifierScan>(__m128i v) {
+    return ~unsigned(_mm_movemask_epi8(identChars16(v))) & 0xFFFFu;
+}
+template <> unsigned stopMask16<DigitScan>(__m128i v) {
+    return ~unsigned(_mm_movemask_epi8(inRange16(v, '0', '9'))) & 0xFFFFu;
+}
+template <> unsigned stopMask16<BlankScan>(__m128i v) {
+    return ~unsigned(_mm_movemask_epi8(blanks16(v))) & 0xFFFFu;
+}
+template <> unsigned stopMask16<QuoteOrNewlineScan>(__m128i v) {
+    __m128i quote = _mm_cmpeq_epi8(v, _mm_set1_epi8('"'));
+    __m128i newline = _mm_cmpeq_epi8(v, _mm_set1_epi8('\n'));
+    return unsigned(_mm_movemask_epi8(_mm_or_si128(quote, newline)));
+}
+
+template <class Scan>
+const char* scanSse2(const char* p, const char* end) {
+    while (end - p >= 16) {
+        unsigned mask = stopMask16<Scan>(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 16;
+    }
+    return scanScalar<Scan>(p, end);
+}
+
+// ---- AVX2 (selected at runtime) ----
+
+#define CHARSCAN_AVX2 __attribute__((target("avx2")))
+
+CHARSCAN_AVX2 inline __m256i inRange32(__m256i x, char lo, char hi) {
+    __m256i shifted = _mm256_sub_epi8(x, _mm256_set1_epi8(lo));
+    return _mm256_cmpeq_epi8(_mm256_min_epu8(shifted, _mm256_set1_epi8(char(hi - lo))), shifted);
+}
+
+CHARSCAN_AVX2 inline __m256i identChars32(__m256i v) {
+    __m256i letter = inRange32(_mm256_or_si256(v, _mm256_set1_epi8(0x20)), 'a', 'z');
+    __m256i digit = inRange32(v, '0', '9');
+    __m256i underscore = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('_'));
+    return _mm256_or_si256(_mm256_or_si256(letter, digit), underscore);
+}
+
+CHARSCAN_AVX2 inline __m256i blanks32(__m256i v) {
+    __m256i space = _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' '));
+    __m256i control = _mm256_andnot_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n')), inRange32(v, '\t', '\r'));
+    return _mm256_or_si256(space, control);
+}
+
+template <class Scan> unsigned stopMask32(__m256i v);
+
+template <> CHARSCAN_AVX2 unsigned stopMask32<IdentifierScan>(__m256i v) {
+    return ~unsigned(_mm256_movemask_epi8(identChars32(v)));
+}
+template <> CHARSCAN_AVX2 unsigned stopMask32<DigitScan>(__m256i v) {
+    return ~unsigned(_mm256_movemask_epi8(inRange32(v, '0', '9')));
+}
+template <> CHARSCAN_AVX2 unsigned stopMask32<BlankScan>(__m256i v) {
+    return ~unsigned(_mm256_movemask_epi8(blanks32(v)));
+}
+template <> CHARSCAN_AVX2 unsigned stopMask32<QuoteOrNewlineScan>(__m256i v) {
+    __m256i quote = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('"'));
+    __m256i newline = _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\n'));
+    return unsigned(_mm256_movemask_epi8(_mm256_or_si256(quote, newline)));
+}
+
+template <class Scan>
+CHARSCAN_AVX2 const char* scanAvx2(const char* p, const char* end) {
+    while (end - p >= 32) {
+        unsigned mask = stopMask32<Scan>(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)));
+        if (mask) return p + __builtin_ctz(mask);
+        p += 32;
+    }
+    // Finish with 16-byte steps before dropping to the table
+    return scanSse2<Scan>(p, end);
+}
+
+#endif // CHARSCAN_X86
+
+using ScanFn = const char* (*)(const char*, const char*);
+
+struct Scanners {
+    Isa isa;
+    ScanFn identifier, digits, blanks, quoteOrNewline;
+};
+
+template <template <class> class Impl>
+constexpr Scanners makeScanners(Isa isa) {
+    return { isa, Impl<IdentifierScan>::run, Impl<DigitScan>::run,
+             Impl<BlankScan>::run, Impl<QuoteOrNewlineScan>::run };
+}
+
+template <class Scan> struct ScalarImpl { static const char* run(const char* p, const char* e) { return scanScalar<Scan>(p, e); } };
+const Scanners scalarScanners = makeScanners<ScalarImpl>(Isa::Scalar);
+
+#ifdef CHARSCAN_X86
+template <class Scan> struct Sse2Impl { static const char* run(const char* p, const char* e) { return scanSse2<Scan>(p, e); } };
+template <class Scan> struct Avx2Impl { static const char* run(const char* p, const char* e) { return scanAvx2<Scan>(p, e); } };
+const Scanners sse2Scanners = makeScanners<Sse2Impl>(Isa::SSE2);
+const Scanners avx2Scanners = makeScanners<Avx2Impl>(Isa::AVX2);
+#endif
+
+Isa detect() {
+#ifdef CHARSCAN_X86
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2") ? Isa::AVX2 : Isa::SSE2;
+#else
+    return Isa::Scalar;
+#endif
+}
+
+const Scanners* scannersFor(Isa isa) {
+#ifdef CHARSCAN_X86
+    if (isa == Isa::AVX2) return &avx2Scanners;
+    if (isa == Isa::SSE2) return &sse2Scanners;
+#endif
+    (void)isa;
+    return &scalarScanners;
+}
+
+atomic<const Scanners*>& active() {
+    static atomic<const Scanners*> scanners{scannersFor(detectedIsa())};
+    return scanners;
+}
+
+inline const Scanners& current() {
+    return *active().load(memory_order_relaxed);
+}
+
+} // namespace
+
+Isa detectedIsa() {
+    static const Isa isa = detect();
+    return isa;
+}
+
+Isa activeIsa() {
+    return current().isa;
+}
+
+void setIsa(Isa isa) {
+    if (int(isa) > int(detectedIsa())) isa = detectedIsa();
+    active().store(scannersFor(isa), memory_order_relaxed);
+}
+
+namespace detail {
+
+const char* skipIdentifierRun(const char* p, const char* end) { return current().identifier(p, end); }
+const char* skipDigitsRun(const char* p, const char* end) { return current().digits(p, end); }
+const char* skipBlanksRun(const char* p, const char* end) { return current().blanks(p, end); }
+const char* findQuoteOrNewlineRun(const char* p, const char* end) { return current().quoteOrNewline(p, end); }
+
+} // namespace detail
+
+const char* findQuote(const char* p, const char* end) {
+    const void* hit = memchr(p, '"', size_t(end - p));
+    return hit ? static_cast<const char*>(hit) : end;
+}
+
+const char* findNewline(const char* p, const char* end) {
+    const void* hit = memchr(p, '\n', size_t(end - p));
+    return hit ? static_cast<const char*>(hit) : end;
+}
+
+} // namespace charscan
@@ -0,0 +1,112 @@
+#ifndef CHARSCAN_H
+#define CHARSCAN_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+using namespace std;
+
+// Byte classification and run scanning for the lexer's hot loops. The class
+// table replaces isalpha/isdigit/isspace (which depend on the C locale and are
+// undefined for negative chars); the skip/find functions scan 16 or 32 bytes
+// per step with SSE2/AVX2 when the CPU has them and fall back to the table
+// otherwise. All functions take [p, end) and return the first position that
+// stops the run, or end.
+namespace charscan {
+
+enum CharClass : uint8_t {
+    IdentStart = 1 << 0,  // a-z A-Z _
+    IdentChar  = 1 << 1,  // a-z A-Z _ 0-9
+    Digit      = 1 << 2,  // 0-9
+    Blank      = 1 << 3,  // whitespace other than '\n': ' ' \t \v \f \r
+    Alnum      = 1 << 4,  // a-z A-Z 0-9
+    HexDigit   = 1 << 5,  // 0-9 a-f A-F
+};
+
+constexpr array<uint8_t, 256> buildClassTable() {
+    array<uint8_t, 256> table{};
+    for (int c = 0; c < 256; ++c) {
+        uint8_t flags = 0;
+        bool alpha = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+        bool digit = c >= '0' && c <= '9';
+        bool hex = digit || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+        if (alpha) flags |= IdentStart | IdentChar;
+        if (digit) flags |= IdentChar | Digit;
+        if ((alpha && c != '_') || digit) flags |= Alnum;
+        if (hex) flags |= HexDigit;
+        if (c == ' ' || c == '\t' || c == '\v' || c == '\f' || c == '\r') flags |= Blank;
+        table[c] = flags;
+    }
+    return table;
+}
+
+inline constexpr array<uint8_t, 256> classTable = buildClassTable();
+
+inline bool is(char c, CharClass cls) { return classTable[uint8_t(c)] & cls; }
+inline bool isIdentStart(char c) { return is(c, IdentStart); }
+inline bool isIdentChar(char c) { return is(c, IdentChar); }
+inline bool isDigit(char c) { return is(c, Digit); }
+inline bool isBlank(char c) { return is(c, Blank); }
+inline bool isAlnum(char c) { return is(c, Alnum); }
+inline bool isHexDigit(char c) { return is(c, HexDigit); }
+
+// Instruction set used by the scanners
+enum class Isa { Scalar, SSE2, AVX2 };
+
+// Best instruction set this CPU supports (checked once at runtime)
+Isa detectedIsa();
+
+// Instruction set currently in use; defaults to detectedIsa()
+Isa activeIsa();
+
+// Switches scanners, e.g. to compare paths; requests above detectedIsa() are clamped
+void setIsa(Isa isa);
+
+namespace detail {
+
+// Vector (or scalar, per activeIsa()) scans, used once a run outgrows the inline prefix
+const char* skipIdentifierRun(const char* p, const char* end);
+const char* skipDigitsRun(const char* p, const char* end);
+const char* skipBlanksRun(const char* p, const char* end);
+const char* findQuoteOrNewlineRun(const char* p, const char* end);
+
+// Most runs in Python source are a few bytes long, so the first block is
+// settled with the table inline and only longer runs pay for a vector scan
+inline constexpr ptrdiff_t inlinePrefix = 16;
+
+template <class Continues>
+inline const char* scanPrefix(const char* p, const char* end, Continues continues,
+                              const char* (*rest)(const char*, const char*)) {
+    const char* stop = end - p > inlinePrefix ? p + inlinePrefix : end;
+    while (p < stop && continues(*p)) ++p;
+    return (p < stop || p == end) ? p : rest(p, end);
+}
+
+} // namespace detail
+
+inline const char* skipIdentifier(const char* p, const char* end) {
+    return detail::scanPrefix(p, end, isIdentChar, detail::skipIdentifierRun);
+}
+
+inline const char* skipDigits(const char* p, const char* end) {
+    return detail::scanPrefix(p, end, isDigit, detail::skipDigitsRun);
+}
+
+inline const char* skipBlanks(const char* p, const char* end) {
+    return detail::scanPrefix(p, end, isBlank, detail::skipBlanksRun);
+}
+
+// First '"' or '\n' (single-line string bodies)
+inline const char* findQuoteOrNewline(const char* p, const char* end) {
+    return detail::scanPrefix(p, end, [](char c) { return c != '"' && c != '\n'; },
+                              detail::findQuoteOrNewlineRun);
+}
+
+// First '"' (triple-quoted string bodies) and first '\n' (comments)
+const char* findQuote(const char* p, const char* end);
+const char* findNewline(const char* p, const char* end);
+
+} // namespace charscan
+
+#endif // CHARSCAN_H
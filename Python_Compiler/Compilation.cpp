@@ -0,0 +1,175 @@
+#include "Compilation.h"
+#include <thread>
+#include "Parallel.h"
+
+Compilation Compilation::run(shared_ptr<SourceBuffer> source, shared_ptr<SymbolTable> symbols, bool lexFirst) {
+    Compilation result;
+    result.source = source;
+
+    auto lexer = symbols ? make_shared<Lexer>(source, move(symbols)) : make_shared<Lexer>(source);
+    result.symbolTable = lexer->symbols();
+    result.parserSymbolTable = make_shared<ParserSymbolTable>(result.symbolTable);
+
+    Parser parser(lexFirst ? TokenStream(make_shared<const TokenBuffer>(lexer->tokenize())) : TokenStream(lexer),
+                  *result.parserSymbolTable);
+    result.tree = parser.parseProgram();
+    result.tokenList = result.tree.tokens;
+    result.parseErrors = parser.takeErrors();
+    return result;
+}
+
+Compilation Compilation::check(shared_ptr<SourceBuffer> source, shared_ptr<SymbolTable> symbols) {
+    Compilation result;
+    result.source = source;
+
+    auto lexer = symbols ? make_shared<Lexer>(source, move(symbols)) : make_shared<Lexer>(source);
+    result.symbolTable = lexer->symbols();
+    result.parserSymbolTable = make_shared<ParserSymbolTable>(result.symbolTable);
+
+    Parser parser(TokenStream(lexer), *result.parserSymbolTable);
+    parser.discardTree();
+    parser.parseProgram();
+    result.parseErrors = parser.takeErrors();
+    return result;
+}
+
+Compilation Compilation::runLazy(shared_ptr<SourceBuffer> source, shared_ptr<SymbolTable> symbols) {
+    Compilation result;
+    result.source = source;
+
+    auto lexer = symbols ? make_shared<Lexer>(source, move(symbols)) : make_shared<Lexer>(source);
+    result.symbolTable = lexer->symbols();
+    result.parserSymbolTable = make_shared<ParserSymbolTable>(result.symbolTable);
+
+    TokenStream tokens(lexer);
+    auto bodies = make_shared<BodyParser>(tokens.share(), result.parserSymbolTable);
+    Parser parser(move(tokens), *result.parserSymbolTable);
+    parser.skipBodies(*bodies);
+    result.tree = parser.parseProgram();
+    result.tree.bodies = move(bodies);
+    result.tree.bodies->errors = parser.takeErrors();
+    result.tokenList = result.tree.tokens;
+    return result;
+}
+
+// Whether the top-level statement loop can start a statement at token index:
+// the first token of a line in column 1, where every block is closed
+static bool startsTopLevelStatement(const TokenBuffer& tokens, size_t index) {
+    TokenType type = tokens.type(index), before = tokens.type(index - 1);
+    return type != TokenType::Newline && type != TokenType::Indent && type != TokenType::Dedent &&
+           type != TokenType::EOFToken && (before == TokenType::Newline || before == TokenType::Dedent) &&
+           tokens.column(index) == 1;
+}
+
+namespace {
+
+// The statements parsed from one piece, and where parsing stopped
+struct ParsedPiece {
+    vector<ASTNode*> statements;
+    vector<ParseError> errors;
+    unique_ptr<AstArena> arena;
+    bool stopped = false;  // at a statement from `to` on; otherwise the program ended
+    uint32_t stoppedAt = 0;
+};
+
+}
+
+// Runs the top-level statement loop from where parser's stream starts until
+// it is about to start a statement at token to or later
+static ParsedPiece parsePiece(Parser& parser, uint32_t to) {
+    ParsedPiece piece;
+    piece.stopped = parser.parseStatementsUntil(piece.statements, nullptr, [&](uint32_t at) {
+        piece.stoppedAt = at;
+        return at >= to;
+    });
+    piece.errors = parser.takeErrors();
+    piece.arena = parser.takeArena();
+    return piece;
+}
+
+Compilation Compilation::runParallel(shared_ptr<SourceBuffer> source, shared_ptr<SymbolTable> symbols,
+                                     unsigned threads, size_t pieceTokens) {
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+
+    auto lexer = symbols ? make_shared<Lexer>(source, move(symbols)) : make_shared<Lexer>(source);
+    auto tokens = make_shared<const TokenBuffer>(lexer->tokenizeParallel(threads));
+    if (pieceTokens == 0) pieceTokens = max<size_t>(16 * 1024, tokens->size() / (size_t(threads) * 4));
+
+    // Piece i is tokens [starts[i], starts[i + 1])
+    vector<uint32_t> starts{ 0 };
+    for (size_t target = pieceTokens; target < tokens->size(); target += pieceTokens) {
+        size_t index = max<size_t>(target, starts.back() + 1);
+        while (index < tokens->size() && !startsTopLevelStatement(*tokens, index)) ++index;
+        if (index >= tokens->size()) break;
+        starts.push_back(uint32_t(index));
+        target = index;
+    }
+    const size_t count = starts.size();
+    starts.push_back(uint32_t(tokens->size()));
+
+    Compilation result;
+    result.source = source;
+    result.symbolTable = lexer->symbols();
+    result.parserSymbolTable = make_shared<ParserSymbolTable>(result.symbolTable);
+    if (count < 2 || threads < 2) {
+        Parser parser(TokenStream(tokens), *result.parserSymbolTable);
+        result.tree = parser.parseProgram();
+        result.tokenList = tokens;
+        result.parseErrors = parser.takeErrors();
+        return result;
+    }
+
+    // Line starts are built on first use; do that before the threads share them
+    tokens->lineOf(0);
+
+    // Parsers and their tables are made here so they live on this thread.
+    // The tables are only for parsing; see redeclare() below
+    vector<unique_ptr<ParserSymbolTable>> tables;
+    vector<unique_ptr<Parser>> parsers;
+    for (size_t i = 0; i < count; ++i) {
+        tables.push_back(make_unique<ParserSymbolTable>(result.symbolTable));
+        parsers.push_back(make_unique<Parser>(TokenStream(tokens, starts[i]), *tables[i]));
+    }
+    vector<ParsedPiece> pieces(count);
+    ::runParallel(count, threads, [&](size_t i) {
+        pieces[i] = parsePiece(*parsers[i], starts[i + 1]);
+    });
+
+    // A piece holds the statements a serial parse would have if that parse
+    // reached its first token at the start of a statement, as the one before
+    // it usually stops there. If that one ran on past it instead (a statement
+    // spanning lines, or stray indentation), the pieces it ran into are
+    // dropped and the rest of the last one parsed again from where it stopped
+    auto arena = make_unique<AstArena>();
+    vector<ASTNode*> statements;
+    uint32_t at = 0;
+    for (size_t i = 0;;) {
+        while (i < count && starts[i] < at) ++i;
+        ParsedPiece piece;
+        if (i < count && starts[i] == at) {
+            piece = move(pieces[i++]);
+        } else {
+            ParserSymbolTable table(result.symbolTable);
+            Parser parser(TokenStream(tokens, at), table);
+            piece = parsePiece(parser, starts[i]);
+        }
+
+        statements.insert(statements.end(), piece.statements.begin(), piece.statements.end());
+        result.parseErrors.insert(result.parseErrors.end(), make_move_iterator(piece.errors.begin()),
+                                  make_move_iterator(piece.errors.end()));
+        arena->adopt(*piece.arena);
+        if (!piece.stopped) break;
+        at = piece.stoppedAt;
+    }
+
+    auto program = arena->make<ProgramNode>();
+    program->children = arena->copy(statements);
+
+    // A piece resolved names against its own declarations only. Declaring
+    // everything again, serially and in order, gives run()'s table
+    Parser(TokenStream(tokens), *result.parserSymbolTable).redeclare(program);
+
+    result.tree = Ast{ move(arena), tokens, program };
+    result.tokenList = tokens;
+    return result;
+}
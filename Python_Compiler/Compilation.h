@@ -0,0 +1,90 @@
+#ifndef COMPILATION_H
+#define COMPILATION_H
+
+#include <memory>
+#include <utility>
+#include <vector>
+#include "parser.h"
+#include "Span.h"
+
+using namespace std;
+
+// Everything one run of the front end produces for a source buffer: the
+// tokens (when kept), the AST, the lexer's and the parser's symbol tables
+// and the parse errors. Accessors hand out views into the result; the take
+// functions move a part out for a caller that wants to keep it longer. A
+// Compilation can be moved but not copied, so none of it is ever duplicated.
+class Compilation {
+public:
+    // Lexes and parses source. Names already in symbols keep their IDs (a
+    // fresh table is used if it is null). The tokens are kept either way,
+    // since the AST refers to them by index. With lexFirst the whole source
+    // is lexed before parsing starts; otherwise the lexer produces tokens
+    // only as the parser reaches them
+    static Compilation run(shared_ptr<SourceBuffer> source, shared_ptr<SymbolTable> symbols = nullptr,
+                           bool lexFirst = false);
+
+    // The same tree and errors as run() on `threads` threads (0: one per
+    // core). The source is lexed with Lexer::tokenizeParallel, then cut
+    // before unindented statements into pieces of about pieceTokens tokens
+    // (0: a few per thread), which are parsed in parallel, each into an
+    // arena of its own. The pieces' statements are joined into one program
+    // in order, so the result does not depend on which thread finished
+    // first. A piece can only resolve names against its own declarations,
+    // so the symbol table is then made by one serial pass over the joined
+    // tree (Parser::redeclare), and is the one run() makes. Inputs too small
+    // to split are parsed by run()
+    static Compilation runParallel(shared_ptr<SourceBuffer> source, shared_ptr<SymbolTable> symbols = nullptr,
+                                   unsigned threads = 0, size_t pieceTokens = 0);
+
+    // Like run(), but function bodies are skipped and each is parsed when
+    // FunctionDefNode::getBody() first asks for it (see BodyParser). Until
+    // then the tree has the top-level statements and every signature, and
+    // errors() only the errors outside bodies not yet parsed.
+    //
+    // The symbol tables differ from run()'s: a function's locals and return
+    // type are unknown until its body is parsed, and what code after it
+    // inferred from calling it meanwhile (x = f() gives x the type function
+    // rather than f's return type) stays as it is once the body is parsed
+    static Compilation runLazy(shared_ptr<SourceBuffer> source, shared_ptr<SymbolTable> symbols = nullptr);
+
+    // The errors and symbol tables of run(), without the tree or the tokens.
+    // Tokens are lexed as the parser reaches them, and each top-level
+    // statement's tokens and nodes are freed once it is parsed (see
+    // Parser::discardTree), so memory does not grow with the source. ast()
+    // is null and tokens() must not be called
+    static Compilation check(shared_ptr<SourceBuffer> source, shared_ptr<SymbolTable> symbols = nullptr);
+
+    Compilation(Compilation&&) = default;
+    Compilation& operator=(Compilation&&) = default;
+
+    shared_ptr<const SourceBuffer> getSource() const { return source; }
+
+    // Every token of the source; the AST's nodes index them
+    const TokenBuffer& tokens() const { return *tokenList; }
+
+    // Null once taken
+    const ProgramNode* ast() const { return tree.root; }
+
+    Span<SymbolTableEntry> symbols() const { return symbolTable->getSymbolTable(); }
+    const ParserSymbolTable& parserSymbols() const { return *parserSymbolTable; }
+    // In the order they were found. For runLazy() those of each body come
+    // after the ones found before it was parsed, not at its place in the source
+    Span<ParseError> errors() const { return tree.bodies ? Span<ParseError>(tree.bodies->errors) : parseErrors; }
+
+    // The tree comes with (a share of) the tokens
+    Ast takeAst() { return exchange(tree, Ast()); }
+    vector<ParseError> takeErrors() { return move(tree.bodies ? tree.bodies->errors : parseErrors); }
+
+private:
+    Compilation() = default;
+
+    shared_ptr<SourceBuffer> source;  // every token and node views its text
+    shared_ptr<const TokenBuffer> tokenList;
+    shared_ptr<SymbolTable> symbolTable;
+    shared_ptr<ParserSymbolTable> parserSymbolTable;  // boxed: entries view it across moves; shared with tree.bodies
+    Ast tree;
+    vector<ParseError> parseErrors;
+};
+
+#endif // COMPILATION_H
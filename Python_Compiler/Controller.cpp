@@ -1,13 +1,73 @@
 #include "Controller.h"
 #include "ParserSymbolTable.h"
+#include <QDir>
 #include <QFile>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
 #include <QDebug>
 #include <QJsonObject>
 #include <QJsonArray>
 #include <QJsonDocument>
 
-QJsonObject astNodeToJson(const ASTNode* node);
+QJsonObject astNodeToJson(const ASTNode* node, const TokenBuffer& tokens);
+
+// Token values are UTF-8 views into the lexer's SourceBuffer
+static QString viewToQString(string_view text) {
+    return QString::fromUtf8(text.data(), qsizetype(text.size()));
+}
+
+static string_view withoutBom(string_view text) {
+    if (text.substr(0, 3) == "\xEF\xBB\xBF") text.remove_prefix(3);
+    return text;
+}
+
+// Maps the file read-only and lexes straight from the mapped bytes. The QFile
+// rides along as the buffer's keep-alive, since closing it drops the mapping.
+// Files that cannot be mapped (empty ones, some devices) are read instead.
+static shared_ptr<SourceBuffer> loadSource(const QString &fileName) {
+    auto file = make_shared<QFile>(fileName);
+    if (!file->open(QIODevice::ReadOnly)) return nullptr;
+
+    const qint64 size = file->size();
+    if (size > 0) {
+        if (uchar *data = file->map(0, size)) {
+            string_view text(reinterpret_cast<const char *>(data), size_t(size));
+            return SourceBuffer::borrow(withoutBom(text), file);
+        }
+    }
+    QByteArray bytes = file->readAll();
+    return make_shared<SourceBuffer>(string(withoutBom(string_view(bytes.constData(), size_t(bytes.size())))));
+}
+
+// Maps a symbol index segment, if the file holds a valid one. The mapping
+// stays alive with the index
+static shared_ptr<const SymbolIndex> openSymbolIndex(const QString &fileName) {
+    auto file = make_shared<QFile>(fileName);
+    if (!file->open(QIODevice::ReadOnly) || file->size() == 0) return nullptr;
+
+    uchar *data = file->map(0, file->size());
+    if (!data) return nullptr;
+    return SymbolIndex::open(string_view(reinterpret_cast<const char *>(data), size_t(file->size())), file);
+}
+
+static QString sha1Of(const QString &text) {
+    return QString::fromLatin1(QCryptographicHash::hash(text.toUtf8(), QCryptographicHash::Sha1).toHex());
+}
+
+// Where the index of the directory holding fileName is kept: a directory
+// in the app's data location named after a hash of the directory's path,
+// with one segment per source file in it. Empty if there is no such location
+static QString symbolIndexDir(const QString &fileName) {
+    const QString dataDir = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+    if (dataDir.isEmpty()) return QString();
+    return dataDir + "/symbol-index/" + sha1Of(QFileInfo(fileName).absolutePath());
+}
+
+static QString symbolIndexSegment(const QString &indexDir, const QString &fileName) {
+    return indexDir + "/" + sha1Of(QFileInfo(fileName).absoluteFilePath()) + ".compy-index";
+}
 
 Controller::Controller(QObject *parent)
     : QObject{parent}
@@ -17,20 +77,23 @@ Controller::Controller(QObject *parent)
 void Controller::loadFile(const QString &path) {
     string fileN =path.toStdString();
     fileN = fileN.substr(8, fileN.length());
-    QFile file(QString::fromStdString(fileN));
 
-    if (file.open(QIODevice::ReadOnly | QIODevice::Text)) {
-        QTextStream in(&file);
-        m_code = in.readAll();
+    auto source = loadSource(QString::fromStdString(fileN));
+    if (source) {
+        m_loadedSource = source;
+        m_loadedPath = QString::fromStdString(fileN);
+        m_editor.reset();
+        m_codeStale = true;  // code() converts to UTF-16 when the editor asks
         emit codeChanged();
 
-        m_lexer = std::make_unique<Lexer>(m_code.toStdString());
+        m_lexer = std::make_unique<Lexer>(source);
     }
 }
 
 void Controller::clearCode()
 {
     m_code.clear();
+    m_codeStale = false;
     m_symbolTable.clear();
     m_parserSymbolTable.clear();
     m_tokens.clear();
@@ -46,77 +109,135 @@ void Controller::clearCode()
     emit parseTreeJsonChanged();
 }
 
+void Controller::appendToken(TokenRef token, int &count, int &errCount) {
+    //if (token.type() == TokenType::Error) return;  //Skip error tokens
+    if (token.type() == TokenType::Indent || token.type() == TokenType::Dedent ||
+        token.type() == TokenType::Newline) return;  //Skip layout tokens
+
+    QString tokenStr = QString::number(count++) + ". <";
+    QString errorStr = "";
+
+    switch (token.type()) {
+    case TokenType::Identifier:
+        tokenStr += "identifier, " + QString::number(token.symbolId());
+        break;
+    case TokenType::Keyword:
+        tokenStr += "keyword, " + viewToQString(token.value());
+        break;
+    case TokenType::Number:
+        tokenStr += "number, " + viewToQString(token.value());
+        break;
+    case TokenType::String:
+        tokenStr += "string, \"" + viewToQString(token.value()) + "\"";
+        break;
+    case TokenType::Operator:
+        tokenStr += "operator, " + viewToQString(token.value());
+        break;
+    case TokenType::Delimiter:
+        tokenStr += viewToQString(token.value());
+        break;
+    case TokenType::Error:
+        errCount++;
+        errorStr = QString::number(errCount) +". Lexical Error:  Invalid token, " + viewToQString(token.value()) + " at line " +  QString::number(token.line()) + ", column " + QString::number(token.column());
+        m_errors.append(errorStr);
+        break;
+    default:
+        tokenStr += "unknown";
+    }
+
+    if (token.type() == TokenType::Error) return;
+
+    tokenStr += "> at line " + QString::number(token.line()) +
+                ", column " + QString::number(token.column());
+    m_tokens.append(tokenStr);
+}
+
+void Controller::showSymbolTable(Span<SymbolTableEntry> symbols) {
+    m_symbolTable.clear();
+    for (const auto &entry : symbols) {
+        m_symbolTable.append( QString::number(entry.id) +
+                             "," + viewToQString(entry.name) +
+                             "," + QString::fromStdString(entry.dataType)+
+                             "," + QString::fromStdString(entry.value));
+    }
+
+    emit symbolTableChanged();
+}
+
 void Controller::runLexer() {
     if (!m_lexer) return;
-    auto tokens = m_lexer->tokenize();
-    lexer_tokens = tokens;
 
     m_tokens.clear();
     m_errors.clear();
 
+    // The token buffer is about 10 bytes a token, far less than the
+    // strings built from it for the view
+    const TokenBuffer tokens = m_lexer->tokenize();
     int count = 1;
     int errCount = 0;
-    for (const auto &token : tokens) {
-        if (token.type == TokenType::EOFToken) break;
-        //if (token.type == TokenType::Error) continue;  //Skip error tokens
-        if (token.type == TokenType::Indent) continue;  //Skip indent tokens
-
-        QString tokenStr = QString::number(count++) + ". <";
-        QString errorStr = "";
-
-        switch (token.type) {
-        case TokenType::Identifier:
-            tokenStr += "identifier, " + QString::number(token.symbolId);
-            break;
-        case TokenType::Keyword:
-            tokenStr += "keyword, " + QString::fromStdString(token.value);
-            break;
-        case TokenType::Number:
-            tokenStr += "number, " + QString::fromStdString(token.value);
-            break;
-        case TokenType::String:
-            tokenStr += "string, \"" + QString::fromStdString(token.value) + "\"";
-            break;
-        case TokenType::Operator:
-            tokenStr += "operator, " + QString::fromStdString(token.value);
-            break;
-        case TokenType::Delimiter:
-            tokenStr += QString::fromStdString(token.value);
-            break;
-        case TokenType::Error:
-            errCount++;
-            errorStr = QString::number(errCount) +". Lexical Error:  Invalid token, " + QString::fromStdString(token.value) + " at line " +  QString::number(token.line) + ", column " + QString::number(token.column);
-            m_errors.append(errorStr);
-            break;
-        default:
-            tokenStr += "unknown";
-        }
-
-        if (token.type == TokenType::Error) continue;
-
-        tokenStr += "> at line " + QString::number(token.line) +
-                    ", column " + QString::number(token.column);
-        m_tokens.append(tokenStr);
+    for (TokenRef token : tokens) {
+        if (token.type() == TokenType::EOFToken) break;
+        appendToken(token, count, errCount);
     }
 
     emit tokensChanged();
     emit errorsChanged();
 
-    m_symbolTable.clear();
-    const auto &symbols = m_lexer->getSymbolTable();
-    for (const auto &entry : symbols) {
-        m_symbolTable.append( QString::number(entry.id) +
-                             "," + QString::fromStdString(entry.name) +
-                             "," + QString::fromStdString(entry.dataType)+
-                             "," + QString::fromStdString(entry.value));
-    }
-
-    emit symbolTableChanged();
+    showSymbolTable(m_lexer->getSymbolTable());
 
     //runParser();
 
 }
 
+void Controller::editCode(int position, int removed, const QString &text) {
+    if (!m_loadedSource) return;
+
+    // QML counts UTF-16 code units; the buffer holds UTF-8
+    const QString current = code();
+    const qsizetype start = current.left(position).toUtf8().size();
+    const qsizetype length = current.mid(position, removed).toUtf8().size();
+    const QByteArray inserted = text.toUtf8();
+
+    // The editor changes m_loadedSource in place, and a mapped one is copied
+    // and unmapped first. The last runParser()'s tokens and symbol values
+    // view that text, so they go before it changes
+    m_compilation.reset();
+
+    if (!m_editor) m_editor = std::make_unique<IncrementalParser>(m_loadedSource);
+    m_editor->replace(size_t(start), size_t(length), string_view(inserted.constData(), size_t(inserted.size())));
+
+    // m_lexer's view of the buffer went stale with the edit. The new one
+    // keeps the editor's symbol IDs
+    m_lexer = std::make_unique<Lexer>(m_loadedSource, m_editor->lexer().symbols());
+
+    m_code.replace(position, removed, text);
+    emit codeChanged();
+
+    m_tokens.clear();
+    m_errors.clear();
+    int count = 1;
+    int errCount = 0;
+    for (TokenRef token : m_editor->tokens()) {
+        if (token.type() == TokenType::EOFToken) break;
+        appendToken(token, count, errCount);
+    }
+    emit tokensChanged();
+    emit errorsChanged();
+
+    showSymbolTable(m_editor->getSymbolTable());
+
+    // The editor keeps the tree up to date as well; its errors are cheap to
+    // show on every edit, the tree itself waits for runParser()
+    m_parserErrors.clear();
+    for (const auto& error : m_editor->errors()) {
+        m_parserErrors.append(QString("Line %1, Col %2: %3")
+                                  .arg(error.line)
+                                  .arg(error.col)
+                                  .arg(QString::fromStdString(error.message)));
+    }
+    emit parserErrorsChanged();
+}
+
 void Controller::runParser()
 {
     if (!m_lexer) {
@@ -125,21 +246,17 @@ void Controller::runParser()
         return;
     }
 
-    // Get tokens and symbol table from lexer
-    const std::vector<Token>& tokenList = lexer_tokens;
-    ParserSymbolTable symTab;
-
-    // Initialize parser
-    m_parser = std::make_unique<Parser>(tokenList, symTab);
+    // The parser pulls tokens from its own lexer over the loaded source as it
+    // goes, lexing and parsing in step. That lexer adds to
+    // m_lexer's symbol table, so both symbol views share its IDs and names,
+    // and the parser's scopes are keyed on them
+    m_compilation = std::make_unique<Compilation>(Compilation::run(m_loadedSource, m_lexer->symbols()));
 
-    // Run parser
-    std::unique_ptr<ProgramNode> ast = m_parser->parseProgram();
-
-    if (ast) {
-        //QJsonObject rootJson = astNodeToJson(ast.get());
+    if (const ProgramNode *ast = m_compilation->ast()) {
+        //QJsonObject rootJson = astNodeToJson(ast, m_compilation->tokens());
         //QJsonDocument doc(rootJson);
         //m_parseTreeJson = doc.toJson(QJsonDocument::Compact);
-        m_parseTreeJson = QString::fromStdString(ast->toParseTreeString());
+        m_parseTreeJson = QString::fromStdString(ast->toParseTreeString(m_compilation->tokens()));
     } else {
         m_parseTreeJson = "{}";
     }
@@ -150,7 +267,7 @@ void Controller::runParser()
 
     // Format and emit errors
     m_parserErrors.clear();
-    for (const auto& error : m_parser->getErrors()) {
+    for (const auto& error : m_compilation->errors()) {
         QString errStr = QString("Line %1, Col %2: %3")
         .arg(error.line)
             .arg(error.col)
@@ -162,23 +279,109 @@ void Controller::runParser()
 
     // Format and emit symbol table
     m_parserSymbolTable.clear();
-    for (const auto& entry : m_parser->getSymbolTable().getEntries()) {
+    const ParserSymbolTable &parserSymbols = m_compilation->parserSymbols();
+    for (const auto& entry : parserSymbols.getEntries()) {
         QString entryStr = QString("ID: %1 ,%2,%3,%4,%5,%6")
         .arg(entry.id)
-            .arg(QString::fromStdString(entry.name))
-            .arg(QString::fromStdString(entry.dataType))
-            .arg(QString::fromStdString(entry.value))
-            .arg(QString::fromStdString(entry.role))
-            .arg(QString::fromStdString(entry.scope));
+            .arg(viewToQString(entry.name))
+            .arg(viewToQString(ParserSymbolTable::typeName(entry.dataType)))
+            .arg(QString::fromStdString(entry.value.toString()))
+            .arg(viewToQString(ParserSymbolTable::roleName(entry.role)))
+            .arg(QString::fromStdString(parserSymbols.scopeName(entry.scope)));
         m_parserSymbolTable.append(entryStr);
         //qDebug() << entryStr;
     }
     emit parserSymbolTableChanged();
 
+    updateSymbolIndex();
+
     // (Optional) TODO: Convert AST to JSON and emit a parseTreeChanged() signal for QML to draw it
 }
 
-QString Controller::code() const { return m_code; }
+// Replaces the loaded file's segment of its directory's index with the
+// definitions and references just parsed. Only that segment is written,
+// so this takes time in proportion to the file, however many others the
+// directory has. The other segments are mapped when the directory changes
+void Controller::updateSymbolIndex() {
+    if (!m_symbolIndexEnabled) return;
+    const QString indexDir = symbolIndexDir(m_loadedPath);
+    if (indexDir.isEmpty()) return;
+    if (m_symbolIndexDir != indexDir) {
+        m_symbolIndex.clear();
+        m_symbolIndexDir = indexDir;
+        const QStringList segments = QDir(indexDir).entryList({ "*.compy-index" }, QDir::Files);
+        for (const QString &segment : segments) m_symbolIndex.put(openSymbolIndex(indexDir + "/" + segment));
+    }
+
+    const QString sourcePath = QFileInfo(m_loadedPath).absoluteFilePath();
+    FileSymbols symbols = FileSymbols::collect(sourcePath.toStdString(), *m_compilation);
+    const string path = symbols.path;
+    string bytes;
+    {
+        SymbolIndexWriter writer;
+        writer.update(move(symbols));
+        bytes = writer.bytes();
+    }
+
+    // The old segment is mapped from the file being replaced
+    m_symbolIndex.remove(path);
+    const QString segmentPath = symbolIndexSegment(indexDir, sourcePath);
+    QDir().mkpath(indexDir);
+    QSaveFile out(segmentPath);
+    if (out.open(QIODevice::WriteOnly) && out.write(bytes.data(), qint64(bytes.size())) == qint64(bytes.size())) {
+        out.commit();
+    }
+    m_symbolIndex.put(openSymbolIndex(segmentPath));
+}
+
+bool Controller::symbolIndexEnabled() const {
+    return m_symbolIndexEnabled;
+}
+
+void Controller::setSymbolIndexEnabled(bool enabled) {
+    if (enabled == m_symbolIndexEnabled) return;
+    m_symbolIndexEnabled = enabled;
+    if (!enabled) {
+        m_symbolIndex.clear();
+        m_symbolIndexDir.clear();
+    }
+    emit symbolIndexEnabledChanged();
+}
+
+QStringList Controller::findSymbol(const QString &name) const {
+    QStringList rows;
+    const QByteArray key = name.toUtf8();
+    const string_view atom(key.constData(), size_t(key.size()));
+    const vector<const SymbolIndex *> segments = m_symbolIndex.segmentsWith(atom);
+    for (const SymbolIndex *segment : segments) {
+        for (const auto &d : segment->definitions(atom)) {
+            rows.append(QString("definition %1:%2:%3 %4 %5 %6")
+                            .arg(viewToQString(segment->fileOf(d.file)))
+                            .arg(d.line)
+                            .arg(d.column)
+                            .arg(viewToQString(ParserSymbolTable::roleName(d.role)))
+                            .arg(viewToQString(ParserSymbolTable::typeName(d.type)))
+                            .arg(viewToQString(segment->text(d.scopePath))));
+        }
+    }
+    for (const SymbolIndex *segment : segments) {
+        for (const auto &r : segment->references(atom)) {
+            rows.append(QString("reference %1:%2:%3")
+                            .arg(viewToQString(segment->fileOf(r.file)))
+                            .arg(r.line)
+                            .arg(r.column));
+        }
+    }
+    return rows;
+}
+
+QString Controller::code() const {
+    if (m_codeStale) {
+        m_code = m_loadedSource ? viewToQString(m_loadedSource->text()) : QString();
+        m_codeStale = false;
+    }
+    return m_code;
+}
 QStringList Controller::tokens() const { return m_tokens; }
 QStringList Controller::symbolTable() const { return m_symbolTable; }
 
@@ -203,28 +406,47 @@ QString Controller::parseTreeJson() const
 }
 
 
-QJsonObject astNodeToJson(const ASTNode* node) {
-    if (!node) return QJsonObject();
-
+// A node's own fields, without its children
+static QJsonObject nodeFields(const ASTNode* node, const TokenBuffer& tokens) {
     QJsonObject obj;
-    obj["type"] = QString::fromStdString(node->getNodeType());
+    obj["type"] = viewToQString(node->getNodeType());
 
     // Only include value for certain node types
-    std::string nodeType = node->getNodeType();
-    if (nodeType != "Program" &&
-        nodeType != "Assign" &&
-        nodeType != "Call") {
-        obj["value"] = QString::fromStdString(node->token.value);
+    if (node->kind != NodeKind::Program &&
+        node->kind != NodeKind::Assign &&
+        node->kind != NodeKind::Call) {
+        obj["value"] = viewToQString(tokens.value(node->token));
     }
+    return obj;
+}
 
-    QJsonArray children;
-    for (const auto& child : node->children) {
-        children.append(astNodeToJson(child.get()));
-    }
+QJsonObject astNodeToJson(const ASTNode* node, const TokenBuffer& tokens) {
+    if (!node) return QJsonObject();
 
-    if (!children.isEmpty()) {
-        obj["children"] = children;
-    }
+    // The nodes from the root down to the one being converted, each with
+    // its children converted so far, so a deep tree does not recurse
+    struct Frame {
+        const ASTNode* node;
+        QJsonObject obj;
+        QJsonArray children;
+        size_t next;
+    };
+    vector<Frame> path{ { node, nodeFields(node, tokens), {}, 0 } };
+    while (true) {
+        Frame& frame = path.back();
+        if (frame.next < frame.node->children.size()) {
+            const ASTNode* child = frame.node->children[frame.next++];
+            if (child) path.push_back({ child, nodeFields(child, tokens), {}, 0 });
+            else frame.children.append(QJsonObject());
+            continue;
+        }
 
-    return obj;
+        if (!frame.children.isEmpty()) {
+            frame.obj["children"] = frame.children;
+        }
+        QJsonObject obj = move(frame.obj);
+        path.pop_back();
+        if (path.empty()) return obj;
+        path.back().children.append(obj);
+    }
 }
@@ -3,7 +3,9 @@
 
 #include <QObject>
 #include <lexer.h>
-#include "parser.h"
+#include "Compilation.h"
+#include "SymbolIndex.h"
+#include "IncrementalParser.h"
 
 class Controller : public QObject
 {
@@ -15,6 +17,7 @@ class Controller : public QObject
     Q_PROPERTY(QStringList parserSymbolTable READ parserSymbolTable NOTIFY parserSymbolTableChanged)
     Q_PROPERTY(QStringList parserErrors READ parserErrors NOTIFY parserErrorsChanged)
     Q_PROPERTY(QString parseTreeJson READ parseTreeJson NOTIFY parseTreeJsonChanged)
+    Q_PROPERTY(bool symbolIndexEnabled READ symbolIndexEnabled WRITE setSymbolIndexEnabled NOTIFY symbolIndexEnabledChanged)
 
 public:
     explicit Controller(QObject *parent = nullptr);
@@ -23,6 +26,21 @@ public:
     Q_INVOKABLE void runLexer();
     Q_INVOKABLE void runParser();
 
+    // Applies an edit made in the editor (positions in QString units) and
+    // re-lexes only the lines it touches; symbol IDs stay the same
+    Q_INVOKABLE void editCode(int position, int removed, const QString &text);
+
+    // Where name is defined and used in the files parsed so far in the
+    // loaded file's directory, one "kind path:line:col ..." row per place.
+    // Empty unless the symbol index is enabled
+    Q_INVOKABLE QStringList findSymbol(const QString &name) const;
+
+    // Whether runParser() keeps a symbol index of each directory it parses
+    // files from. Off by default; the indexes go in the app's data
+    // location, not next to the sources
+    bool symbolIndexEnabled() const;
+    void setSymbolIndexEnabled(bool enabled);
+
     QString code() const;
     QStringList tokens() const;
     QStringList symbolTable() const;
@@ -41,13 +59,23 @@ signals:
     void errorsChanged();
 
 private:
-    vector<Token> lexer_tokens;
-    QString m_code;
+    void appendToken(TokenRef token, int &count, int &errCount);
+    void showSymbolTable(Span<SymbolTableEntry> symbols);
+    void updateSymbolIndex();
+
+    shared_ptr<SourceBuffer> m_loadedSource;  // last loaded file, usually memory-mapped
+    QString m_loadedPath;
+    mutable QString m_code;  // built from m_loadedSource on demand
+    mutable bool m_codeStale = false;
     QStringList m_tokens;
     QStringList m_symbolTable;
     QStringList m_errors;
     std::unique_ptr<Lexer> m_lexer;
-    std::unique_ptr<Parser> m_parser;
+    std::unique_ptr<IncrementalParser> m_editor;  // created by the first editCode()
+    std::unique_ptr<Compilation> m_compilation;  // from the last runParser()
+    bool m_symbolIndexEnabled = false;
+    SymbolIndexSet m_symbolIndex;  // segments mapped from m_symbolIndexDir
+    QString m_symbolIndexDir;
 
 
     QStringList m_parserErrors;
@@ -60,6 +88,7 @@ signals:
     void parserErrorsChanged();
     void parserSymbolTableChanged();
     void parseTreeJsonChanged();
+    void symbolIndexEnabledChanged();
 };
 
 #endif // CONTROLLER_H
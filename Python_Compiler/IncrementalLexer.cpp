@@ -0,0 +1,170 @@
+#include "IncrementalLexer.h"
+#include <algorithm>
+
+// Sets the blocks of line (counted from lines[0]); the lines before it
+// that have no tokens get the ones already open
+static void setLine(vector<uint32_t>& lines, size_t line, uint32_t block) {
+    if (lines.size() < line) lines.resize(line, lines.empty() ? 0 : lines.back());
+    lines.push_back(block);
+}
+
+IncrementalLexer::IncrementalLexer(shared_ptr<SourceBuffer> buffer)
+    : source(buffer), lexer(buffer) {
+    tokenList = make_shared<TokenBuffer>(lexer.tokenizeParallel());
+
+    // The lexer measures the indentation of the line each Newline leads to
+    uint32_t open = 0;
+    for (size_t i = 0; i < tokenList->size(); ++i) {
+        uint32_t at = tokenList->offset(i);
+        if ((i == 0 || tokenList->type(i - 1) == TokenType::Newline) && at < source->size()) {
+            int line = tokenList->line(i);
+            open = blocksAfter(open, Lexer::indentWidth(source->text(), tokenList->lineStart(line)));
+            setLine(lineBlocks, size_t(line - 1), open);
+        }
+    }
+    lineBlocks.resize(size_t(tokenList->lineOf(source->size())), lineBlocks.empty() ? 0 : lineBlocks.back());
+}
+
+uint32_t IncrementalLexer::blocksAfter(uint32_t open, int width) {
+    while (blocks[open].width > width) open = blocks[open].outer;
+    if (blocks[open].width == width) return open;
+
+    auto [it, added] = blockIds.try_emplace(uint64_t(open) << 32 | uint32_t(width), uint32_t(blocks.size()));
+    if (added) blocks.push_back({ width, open });
+    return it->second;
+}
+
+vector<int> IncrementalLexer::widths(uint32_t block) const {
+    vector<int> open{ blocks[block].width };
+    for (; block != 0; block = blocks[block].outer) open.push_back(blocks[blocks[block].outer].width);
+    reverse(open.begin(), open.end());
+    return open;
+}
+
+static bool isLayout(TokenType type) {
+    return type == TokenType::Newline || type == TokenType::Indent ||
+           type == TokenType::Dedent || type == TokenType::EOFToken;
+}
+
+// Whether a token of type after one of type previous is the first of a line.
+// An Error there may be the one for an unindent that matches no block, which
+// the lexer owes before the line's first token, so it is never taken
+static bool startsLine(TokenType previous, TokenType type) {
+    return !isLayout(type) && type != TokenType::Error &&
+           (previous == TokenType::Newline || previous == TokenType::Indent || previous == TokenType::Dedent);
+}
+
+bool IncrementalLexer::isCheckpoint(size_t index) const {
+    return index > 0 && startsLine(tokenList->type(index - 1), tokenList->type(index));
+}
+
+size_t IncrementalLexer::resumeIndex(size_t offset) const {
+    // Step back from the first token of the edited line. The line's own
+    // Indent or Dedents depend on its indentation, so it cannot be the checkpoint
+    size_t lineStart = tokenList->lineStart(tokenList->lineOf(offset));
+    size_t low = 0, index = tokenList->size();
+    while (low < index) {
+        size_t mid = (low + index) / 2;
+        if (tokenList->offset(mid) < lineStart) low = mid + 1;
+        else index = mid;
+    }
+    while (index > 0 && !isCheckpoint(index - 1)) --index;
+    return index > 0 ? index - 1 : 0;
+}
+
+IncrementalLexer::Edit IncrementalLexer::replace(size_t offset, size_t length, string_view text) {
+    offset = min(offset, source->size());
+    length = min(length, source->size() - offset);
+
+    // Resuming at a checkpoint keeps the Indent or Dedents in front of it,
+    // which only depend on earlier lines
+    size_t resume = resumeIndex(offset);
+    size_t resumeOffset = resume > 0 ? tokenList->offset(resume) : 0;
+    int resumeLine = resume > 0 ? tokenList->line(resume) : 1;
+    int resumeColumn = resume > 0 ? tokenList->column(resume) : 1;
+    uint32_t open = resume > 0 ? lineBlocks[size_t(resumeLine - 1)] : 0;
+
+    ptrdiff_t delta = ptrdiff_t(text.size()) - ptrdiff_t(length);
+    size_t editEnd = offset + text.size();  // in the new text
+    string_view removed = source->text().substr(offset, length);
+    int lineDelta = int(std::count(text.begin(), text.end(), '\n') - std::count(removed.begin(), removed.end(), '\n'));
+
+    source->replace(offset, length, text);
+    tokenList->editLines(offset, length, text);
+
+    // Re-lex until the first token of a line past the edit lines up with a
+    // checkpoint of the old stream (old index `rejoin`) inside the same
+    // blocks, or until EOF. The Indent or Dedents before it may differ and
+    // are taken from the new stream
+    if (resume > 0) lexer.resume(resumeOffset, resumeLine, resumeColumn, widths(open));
+    else lexer.seek(0, 1);
+    TokenBuffer fresh(source);
+    vector<uint32_t> freshLines;  // lineBlocks from resumeLine on
+    if (resume > 0) freshLines.push_back(open);
+    size_t rejoin = tokenList->size();
+    size_t rejoinLine = lineBlocks.size() + 1;  // in the old text
+    size_t old = resume + 1;
+    TokenType previous = resume > 0 ? tokenList->type(resume - 1) : TokenType::Newline;
+    bool measure = resume == 0;  // whether the lexer measures the indentation in front of the next token
+    while (true) {
+        Token token = lexer.nextToken();
+        if (measure && token.offset < source->size()) {
+            open = blocksAfter(open, Lexer::indentWidth(source->text(), token.offset - size_t(token.column - 1)));
+            setLine(freshLines, size_t(token.line - resumeLine), open);
+        }
+        if (token.offset > editEnd && startsLine(previous, token.type)) {
+            size_t oldOffset = size_t(ptrdiff_t(token.offset) - delta);
+            while (old < tokenList->size() &&
+                   (tokenList->offset(old) < oldOffset ||
+                    (tokenList->offset(old) == oldOffset && isLayout(tokenList->type(old))))) ++old;
+            // The text from oldOffset on is unchanged, and the lexer is in the
+            // same state at both if the same blocks are open there
+            size_t oldLine = size_t(token.line - lineDelta);
+            if (old < tokenList->size() && tokenList->offset(old) == oldOffset && isCheckpoint(old) &&
+                tokenList->type(old) == token.type && lineBlocks[oldLine - 1] == open) {
+                rejoin = old;
+                rejoinLine = oldLine;
+                break;
+            }
+        }
+        previous = token.type;
+        measure = token.type == TokenType::Newline;
+        fresh.append(token);
+        if (token.type == TokenType::EOFToken) break;
+    }
+
+    // The lines up to the rejoining one were lexed again; those after it moved
+    size_t lastLine = rejoin < tokenList->size() ? rejoinLine + size_t(lineDelta) : size_t(tokenList->lineOf(source->size())) + 1;
+    freshLines.resize(lastLine - size_t(resumeLine), freshLines.empty() ? 0 : freshLines.back());
+    auto replaced = lineBlocks.erase(lineBlocks.begin() + (resumeLine - 1), lineBlocks.begin() + ptrdiff_t(rejoinLine - 1));
+    lineBlocks.insert(replaced, freshLines.begin(), freshLines.end());
+
+    // Tokens that end a character before the edit, or start a character
+    // after it, saw the same text as before; those that also came out alike
+    // are not reported as changed
+    size_t same = 0;
+    while (resume + same + 1 < rejoin && same < fresh.size() && tokenList->offset(resume + same + 1) < offset &&
+           tokenList->sameToken(resume + same, fresh, same, 0)) ++same;
+    size_t sameAfter = 0;
+    while (resume + same + sameAfter < rejoin && same + sameAfter < fresh.size() &&
+           tokenList->offset(rejoin - sameAfter - 1) > offset + length &&
+           tokenList->sameToken(rejoin - sameAfter - 1, fresh, fresh.size() - sameAfter - 1, delta)) ++sameAfter;
+    Edit edit{ resume + same, rejoin - resume - same - sameAfter, fresh.size() - same - sameAfter, fresh.size() };
+
+    // Type patterns never reach past the end of a line, so they can only
+    // change if an identifier was lexed again or removed
+    bool retype = false;
+    for (size_t i = 0; i < fresh.size() && !retype; ++i) retype = fresh.type(i) == TokenType::Identifier;
+    for (size_t i = resume; i < rejoin && !retype; ++i) retype = tokenList->type(i) == TokenType::Identifier;
+
+    tokenList->splice(resume, rejoin, fresh, delta);
+
+    typesStale = typesStale || retype;
+    return edit;
+}
+
+Span<SymbolTableEntry> IncrementalLexer::getSymbolTable() {
+    if (typesStale) lexer.retype(*tokenList);
+    typesStale = false;
+    return lexer.getSymbolTable();
+}
@@ -0,0 +1,87 @@
+#ifndef INCREMENTALLEXER_H
+#define INCREMENTALLEXER_H
+
+#include <unordered_map>
+#include "lexer.h"
+
+using namespace std;
+
+// Keeps the token list of a buffer up to date while the text is edited.
+//
+// The first token of a line, once the Indent or Dedents in front of it are
+// out, marks a point where the lexer holds no state beyond (offset, line)
+// and the widths of the blocks open there: it is outside any string, and
+// no Dedents are owed. Those widths are kept for every line. An edit
+// re-lexes from the last such token on a line before the edited one, and
+// stops at the first one past the edit that the old stream also had, inside
+// the same blocks. From there on both streams are the same except for
+// shifted offsets, so the old tokens are kept and only moved (lines and
+// columns follow from the offsets). Symbol IDs never change: the same symbol
+// table is used throughout and entries are never removed.
+//
+// Most of the tokens lexed again come out as they were. replace() reports
+// just the run that differs, which is what a parser has to look at again.
+class IncrementalLexer {
+public:
+    // Lexes the whole buffer once. replace() edits the buffer in place, so
+    // other holders of it must not keep views into its text across edits
+    explicit IncrementalLexer(shared_ptr<SourceBuffer> buffer);
+
+    // What replace() did to the token list: tokens [first, first + removed)
+    // became [first, first + inserted), and the ones after them moved by
+    // inserted - removed places. relexed tokens were lexed again to find that
+    struct Edit {
+        size_t first, removed, inserted;
+        size_t relexed;
+    };
+
+    // Replaces length bytes at offset with text and updates the token list
+    Edit replace(size_t offset, size_t length, string_view text);
+
+    // Valid until the next replace()
+    const TokenBuffer& tokens() const { return *tokenList; }
+
+    // The same list, updated in place by every replace()
+    shared_ptr<const TokenBuffer> share() const { return tokenList; }
+
+    string_view text() const { return source->text(); }
+
+    // Valid until the next replace(). Types are worked out again here, if
+    // an edit may have changed them; that goes over every token
+    Span<SymbolTableEntry> getSymbolTable();
+
+    // The table the token list's symbol IDs index. Its types can be out of
+    // date until getSymbolTable() is called
+    shared_ptr<SymbolTable> symbols() const { return lexer.symbols(); }
+
+private:
+    shared_ptr<SourceBuffer> source;
+    Lexer lexer;
+    shared_ptr<TokenBuffer> tokenList;
+    bool typesStale = false;
+
+    // The blocks open at the first token of each line, as nodes of a tree:
+    // the innermost block's width and the node of the block around it. Equal
+    // stacks get the same node, so two lines are in the same blocks if they
+    // have the same node
+    struct Block {
+        int width;
+        uint32_t outer;
+    };
+    vector<Block> blocks{ { 0, 0 } };           // 0: the top level
+    unordered_map<uint64_t, uint32_t> blockIds;  // (outer, width) -> node
+    vector<uint32_t> lineBlocks;                // by line - 1; lines without tokens repeat the one before
+
+    // The blocks open on a line of that width after those open before it
+    uint32_t blocksAfter(uint32_t open, int width);
+    vector<int> widths(uint32_t block) const;
+
+    // Whether tokenList[index] is a point to resume or rejoin the lexer at
+    bool isCheckpoint(size_t index) const;
+
+    // Index of the last checkpoint on a line before the one containing
+    // offset, or 0 (the start of the input) if there is none
+    size_t resumeIndex(size_t offset) const;
+};
+
+#endif // INCREMENTALLEXER_H
@@ -0,0 +1,226 @@
+#include "IncrementalParser.h"
+#include <algorithm>
+
+IncrementalParser::IncrementalParser(shared_ptr<SourceBuffer> buffer)
+    : tokenizer(buffer) {
+    parseAll();
+}
+
+void IncrementalParser::parseAll() {
+    layouts.clear();
+    symbolTable = make_unique<ParserSymbolTable>(tokenizer.symbols());
+    Parser parser(TokenStream(tokenizer.share()), *symbolTable);
+    parser.keepLayouts(layouts);
+    tree = parser.parseProgram();
+    parseErrors = parser.takeErrors();
+    parsedSize = tree.arena->memoryUsage();
+}
+
+// The last resume point before token first, or the body's start
+static size_t resumeBefore(const BodyLayout& layout, uint32_t first) {
+    auto after = lower_bound(layout.resume.begin(), layout.resume.end(), first,
+                             [](const ResumePoint& point, uint32_t token) { return point.token < token; });
+    return after == layout.resume.begin() ? 0 : size_t(after - layout.resume.begin()) - 1;
+}
+
+// The statements a resume point's loop iterations parsed, as indices into
+// the body's children
+static pair<size_t, size_t> statementsAt(const ASTNode* body, const BodyLayout& layout, size_t point) {
+    size_t last = point + 1 < layout.resume.size() ? layout.resume[point + 1].children : body->children.size();
+    return { layout.resume[point].children, last };
+}
+
+// The blocks of a compound statement: its body, or an if's branches. As
+// everywhere in a tree with errors, a child can be missing
+template <typename F>
+static void forEachBlock(const ASTNode* statement, F f) {
+    for (ASTNode* child : statement->children) {
+        if (!child) continue;
+        if (child->kind == NodeKind::Block || child->kind == NodeKind::Else) f(child);
+        else if (child->kind == NodeKind::Elif) f(static_cast<ElifNode*>(child)->getThenBranch());
+    }
+}
+
+size_t IncrementalParser::replace(size_t offset, size_t length, string_view text) {
+    symbolTable->detachFrom(tokenizer.text());
+    IncrementalLexer::Edit edit = tokenizer.replace(offset, length, text);
+
+    size_t parsed = 0;
+    if (edit.removed > 0 || edit.inserted > 0) {
+        // The bodies from the program down to the innermost one whose
+        // statements hold every changed token. Its own first token and the
+        // Dedent after it must not change, as those are read by the
+        // statement around it
+        uint32_t first = uint32_t(edit.first), changedEnd = uint32_t(edit.first + edit.removed);
+        vector<ASTNode*> path{ tree.root };
+        while (true) {
+            const BodyLayout& layout = layouts.at(path.back());
+            auto [from, to] = statementsAt(path.back(), layout, resumeBefore(layout, first));
+            ASTNode* inner = nullptr;
+            for (size_t i = from; i < to && !inner; ++i) {
+                forEachBlock(path.back()->children[i], [&](ASTNode* block) {
+                    auto found = layouts.find(block);
+                    if (found != layouts.end() && found->second.resume[0].token < first &&
+                        changedEnd <= found->second.end) inner = block;
+                });
+            }
+            if (!inner) break;
+            path.push_back(inner);
+        }
+
+        while (!reparse(path, edit, parsed)) path.pop_back();
+    }
+
+    // Tokens after the edit may have moved to other lines and columns
+    for (ParseError& error : parseErrors) {
+        if (error.token == ParseError::noToken || error.token < edit.first) continue;
+        error.line = tokens().line(error.token);
+        error.col = tokens().column(error.token);
+    }
+
+    if (tree.arena->memoryUsage() > 2 * parsedSize) {
+        parseAll();
+        parsed = tokens().size();
+    }
+    return parsed;
+}
+
+bool IncrementalParser::reparse(const vector<ASTNode*>& path, const IncrementalLexer::Edit& edit, size_t& parsed) {
+    ASTNode* body = path.back();
+    BodyLayout& layout = layouts.at(body);
+    uint32_t first = uint32_t(edit.first), changedEnd = uint32_t(edit.first + edit.removed);
+    ptrdiff_t shift = ptrdiff_t(edit.inserted) - ptrdiff_t(edit.removed);
+    size_t point = resumeBefore(layout, first);
+    ResumePoint from = layout.resume[point];
+
+    // The scopes down to the body's, as they were when it was parsed
+    int reopened = symbolTable->reopenScopes(layout.scope);
+
+    Parser parser(TokenStream(tokenizer.share(), from.token), *symbolTable);
+    parser.useArena(move(tree.arena));
+    BodyLayouts nested;
+    parser.keepLayouts(nested);
+
+    // Error counts in redone and nested start from the parser's, at 0
+    BodyLayout redone{ layout.scope, 0, 0, { { from.token, from.children, 0 } } };
+    vector<ASTNode*> statements(body->children.begin(), body->children.begin() + from.children);
+    size_t rejoin = layout.resume.size();
+    uint32_t stoppedAt = 0;
+    bool stopped = parser.parseStatementsUntil(statements, &redone, [&](uint32_t at) {
+        if (at < first + edit.inserted) return false;
+        uint32_t old = uint32_t(ptrdiff_t(at) - shift);
+        auto found = lower_bound(layout.resume.begin() + point + 1, layout.resume.end(), old,
+                                 [](const ResumePoint& p, uint32_t token) { return p.token < token; });
+        if (found == layout.resume.end() || found->token != old) return false;
+        rejoin = size_t(found - layout.resume.begin());
+        stoppedAt = at;
+        return true;
+    });
+
+    tree.arena = parser.takeArena();
+    for (int i = 0; i < reopened; ++i) symbolTable->endScope();
+    parsed += (stopped ? stoppedAt : redone.end) - from.token;
+    if (!stopped && body != tree.root && ptrdiff_t(redone.end) != ptrdiff_t(layout.end) + shift) return false;
+
+    // Replaced: statements [from.children, childrenEnd) and errors
+    // [from.errors, errorsEnd) of the old parse
+    vector<ParseError> fresh = parser.takeErrors();
+    size_t childrenEnd = stopped ? layout.resume[rejoin].children : body->children.size();
+    size_t errorsEnd = stopped ? layout.resume[rejoin].errors : layout.errorsEnd;
+    ptrdiff_t childShift = ptrdiff_t(statements.size()) - ptrdiff_t(childrenEnd);
+    ptrdiff_t errorShift = ptrdiff_t(fresh.size()) - ptrdiff_t(errorsEnd - from.errors);
+
+    for (size_t i = from.children; i < childrenEnd; ++i) dropLayouts(body->children[i]);
+
+    // Everything after the changed tokens moves along, from the top-level
+    // statement the edit is in on
+    if (shift != 0 || errorShift != 0) {
+        BodyLayout& program = layouts.at(tree.root);
+        size_t top = statementsAt(tree.root, program, resumeBefore(program, first)).first;
+        for (size_t i = top; i < tree.root->children.size(); ++i) {
+            moveFrom(tree.root->children[i], changedEnd, shift, errorShift);
+        }
+        moveLayout(program, changedEnd, shift, errorShift);
+    }
+
+    for (size_t i = errorsEnd; i < parseErrors.size(); ++i) {
+        if (parseErrors[i].token != ParseError::noToken) parseErrors[i].token = uint32_t(parseErrors[i].token + shift);
+    }
+    parseErrors.erase(parseErrors.begin() + from.errors, parseErrors.begin() + errorsEnd);
+    parseErrors.insert(parseErrors.begin() + from.errors, make_move_iterator(fresh.begin()), make_move_iterator(fresh.end()));
+
+    // The body's children, in place if there are as many as before
+    statements.insert(statements.end(), body->children.begin() + childrenEnd, body->children.end());
+    if (statements.size() == body->children.size()) {
+        copy(statements.begin(), statements.end(), const_cast<ASTNode**>(body->children.data()));
+    } else {
+        body->children = tree.arena->copy(statements);
+    }
+
+    // Its layout: the old resume points up to the one parsing started at,
+    // the new ones, then the old ones from where parsing stopped
+    for (ResumePoint& p : redone.resume) p.errors += from.errors;
+    for (size_t i = rejoin; i < layout.resume.size(); ++i) {
+        ResumePoint p = layout.resume[i];
+        p.children = uint32_t(p.children + childShift);
+        redone.resume.push_back(p);
+    }
+    layout.resume.erase(layout.resume.begin() + point, layout.resume.end());
+    layout.resume.insert(layout.resume.end(), redone.resume.begin(), redone.resume.end());
+    if (!stopped) {
+        layout.end = redone.end;
+        layout.errorsEnd = redone.errorsEnd + from.errors;
+    }
+
+    for (auto& [block, blockLayout] : nested) {
+        for (ResumePoint& p : blockLayout.resume) p.errors += from.errors;
+        blockLayout.errorsEnd += from.errors;
+        layouts[block] = move(blockLayout);
+    }
+    return true;
+}
+
+void IncrementalParser::moveFrom(ASTNode* root, uint32_t from, ptrdiff_t shift, ptrdiff_t errorShift) {
+    vector<ASTNode*> pending{ root };
+    while (!pending.empty()) {
+        ASTNode* node = pending.back();
+        pending.pop_back();
+        if (!node) continue;
+        if (node->token != ASTNode::noToken && node->token >= from) node->token = uint32_t(node->token + shift);
+        if (node->kind == NodeKind::FunctionDef) {
+            auto function = static_cast<FunctionDefNode*>(node);
+            uint32_t* params = const_cast<uint32_t*>(function->params.data());
+            for (size_t i = 0; i < function->params.size(); ++i) {
+                if (params[i] >= from) params[i] = uint32_t(params[i] + shift);
+            }
+        }
+        if (node->kind == NodeKind::Block || node->kind == NodeKind::Else) {
+            auto found = layouts.find(node);
+            if (found != layouts.end()) moveLayout(found->second, from, shift, errorShift);
+        }
+        pending.insert(pending.end(), node->children.begin(), node->children.end());
+    }
+}
+
+void IncrementalParser::moveLayout(BodyLayout& layout, uint32_t from, ptrdiff_t shift, ptrdiff_t errorShift) {
+    for (ResumePoint& point : layout.resume) {
+        if (point.token < from) continue;
+        point.token = uint32_t(point.token + shift);
+        point.errors = uint32_t(point.errors + errorShift);
+    }
+    if (layout.end >= from) {
+        layout.end = uint32_t(layout.end + shift);
+        layout.errorsEnd = uint32_t(layout.errorsEnd + errorShift);
+    }
+}
+
+void IncrementalParser::dropLayouts(const ASTNode* root) {
+    vector<const ASTNode*> pending{ root };
+    while (!pending.empty()) {
+        const ASTNode* node = pending.back();
+        pending.pop_back();
+        if (!node) continue;
+        if (node->kind == NodeKind::Block || node->kind == NodeKind::Else) layouts.erase(node);
+        pending.insert(pending.end(), node->children.begin(), node->children.end());
+    }
+}
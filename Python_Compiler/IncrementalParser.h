@@ -0,0 +1,73 @@
+#ifndef INCREMENTALPARSER_H
+#define INCREMENTALPARSER_H
+
+#include "IncrementalLexer.h"
+#include "parser.h"
+
+using namespace std;
+
+// Keeps the AST of a buffer up to date while the text is edited, on top of
+// an IncrementalLexer.
+//
+// Along with the tree it keeps every body's layout (see BodyLayout): the
+// tokens its statement loop can be resumed at, and the Dedent that ends it.
+// An edit goes down to the innermost body that holds all the tokens the
+// lexer reports as changed, and parses it again from the last resume point
+// before them. It stops at the first statement past them that starts where
+// one of the old parse did: from there on the tokens are the same, so the
+// old statements are kept and only their token indices are moved. If the
+// body runs to its end instead, that must be its old end, moved; otherwise
+// the edit changed where the body ends, and the body around it is parsed
+// again the same way. The program runs to EOF, so that always works.
+//
+// The statements parsed again go into their old scope, reopened, so their
+// declarations update the entries made there before. Entries are not
+// removed, though, and kept statements are not looked at again. Until the
+// next full parse the table can hold names that were edited away, types
+// inferred from values that have changed since, and lines from before the
+// edit. Replaced nodes stay in the arena; once they outweigh the tree, the
+// whole buffer is parsed again.
+class IncrementalParser {
+public:
+    // Lexes and parses the whole buffer once
+    explicit IncrementalParser(shared_ptr<SourceBuffer> buffer);
+
+    // Replaces length bytes at offset with text and updates the tokens, the
+    // tree and the errors. Returns how many tokens were parsed again
+    size_t replace(size_t offset, size_t length, string_view text);
+
+    // All valid until the next replace()
+    const ProgramNode* ast() const { return tree.root; }
+    const TokenBuffer& tokens() const { return tokenizer.tokens(); }
+    Span<ParseError> errors() const { return parseErrors; }
+    const ParserSymbolTable& parserSymbols() const { return *symbolTable; }
+
+    const IncrementalLexer& lexer() const { return tokenizer; }
+
+    // The lexer's symbol table, with its types brought up to date
+    Span<SymbolTableEntry> getSymbolTable() { return tokenizer.getSymbolTable(); }
+
+private:
+    IncrementalLexer tokenizer;
+    unique_ptr<ParserSymbolTable> symbolTable;
+    Ast tree;
+    BodyLayouts layouts;
+    vector<ParseError> parseErrors;
+    size_t parsedSize = 0;  // arena bytes after the last full parse
+
+    void parseAll();
+
+    // Parses path.back()'s body again over the changed tokens; false if that
+    // changed where it ends. Adds the tokens it parsed to parsed
+    bool reparse(const vector<ASTNode*>& path, const IncrementalLexer::Edit& edit, size_t& parsed);
+
+    // Moves the token indices in root's subtree that are from `from` on by
+    // shift places, and the error counts of resume points there by errorShift
+    void moveFrom(ASTNode* root, uint32_t from, ptrdiff_t shift, ptrdiff_t errorShift);
+    static void moveLayout(BodyLayout& layout, uint32_t from, ptrdiff_t shift, ptrdiff_t errorShift);
+
+    // Forgets the layouts of the bodies in root
+    void dropLayouts(const ASTNode* root);
+};
+
+#endif // INCREMENTALPARSER_H
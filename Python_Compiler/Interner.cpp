@@ -0,0 +1,72 @@
+#include "Interner.h"
+#include <cstring>
+
+uint32_t Interner::intern(string_view name, uint32_t hash) {
+    if ((names.size() + 1) * 2 > table.size()) rehash(max(slotBits + 1, 8u));
+
+    size_t mask = table.size() - 1;
+    for (size_t i = home(hash);; i = (i + 1) & mask) {
+        Slot& slot = table[i];
+        if (slot.atom == empty) {
+            uint32_t atom = uint32_t(names.size());
+            slot = { hash, atom };
+            names.push_back(copy(name));
+            hashes.push_back(hash);
+            return atom;
+        }
+        if (slot.hash == hash && names[slot.atom] == name) return slot.atom;
+    }
+}
+
+int Interner::find(string_view name, uint32_t hash) const {
+    if (table.empty()) return -1;
+    size_t mask = table.size() - 1;
+    for (size_t i = home(hash);; i = (i + 1) & mask) {
+        const Slot& slot = table[i];
+        if (slot.atom == empty) return -1;
+        if (slot.hash == hash && names[slot.atom] == name) return int(slot.atom);
+    }
+}
+
+void Interner::reserve(size_t count) {
+    unsigned bits = max(slotBits, 8u);
+    while ((size_t(1) << bits) < count * 2) ++bits;
+    if (bits != slotBits) rehash(bits);
+    names.reserve(count);
+    hashes.reserve(count);
+}
+
+void Interner::rehash(unsigned bits) {
+    slotBits = bits;
+    table.assign(size_t(1) << bits, { 0, empty });
+    size_t mask = table.size() - 1;
+    for (uint32_t atom = 0; atom < names.size(); ++atom) {
+        size_t i = home(hashes[atom]);
+        while (table[i].atom != empty) i = (i + 1) & mask;
+        table[i] = { hashes[atom], atom };
+    }
+}
+
+string_view Interner::copy(string_view name) {
+    if (name.size() > chunkSize) {
+        // A name longer than a chunk gets one of its own; the current chunk keeps filling
+        chunks.insert(chunks.begin(), unique_ptr<char[]>(new char[name.size()]));
+        arenaBytes += name.size();
+        memcpy(chunks.front().get(), name.data(), name.size());
+        return string_view(chunks.front().get(), name.size());
+    }
+    if (name.size() > chunkSize - chunkUsed || chunkUsed == chunkSize) {
+        chunks.push_back(unique_ptr<char[]>(new char[chunkSize]));
+        arenaBytes += chunkSize;
+        chunkUsed = 0;
+    }
+    char* at = chunks.back().get() + chunkUsed;
+    memcpy(at, name.data(), name.size());
+    chunkUsed += name.size();
+    return string_view(at, name.size());
+}
+
+size_t Interner::memoryUsage() const {
+    return arenaBytes + table.size() * sizeof(Slot) +
+           names.size() * sizeof(string_view) + hashes.size() * sizeof(uint32_t);
+}
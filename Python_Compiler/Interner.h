@@ -0,0 +1,68 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// Identifier names, each stored once, and a dense 32-bit atom per distinct
+// name (0, 1, 2, ... in order of first intern). Names are copied into large
+// arena chunks that never move, so name() views stay valid for the life of
+// the interner. Lookup is a single open-addressing probe sequence over
+// (hash, atom) slots; the hash is FNV-1a, which the lexer computes over the
+// identifier right after charscan::skipIdentifier finds its end.
+class Interner {
+public:
+    static constexpr uint32_t hashSeed = 2166136261u;
+    static constexpr uint32_t hashStep(uint32_t hash, char c) { return (hash ^ uint8_t(c)) * 16777619u; }
+
+    static uint32_t hash(string_view name) {
+        uint32_t h = hashSeed;
+        for (char c : name) h = hashStep(h, c);
+        return h;
+    }
+
+    // The atom for name, added if new. hash must be hash(name)
+    uint32_t intern(string_view name, uint32_t hash);
+    uint32_t intern(string_view name) { return intern(name, hash(name)); }
+
+    // The atom for name, or -1 if it was never interned
+    int find(string_view name, uint32_t hash) const;
+    int find(string_view name) const { return find(name, hash(name)); }
+
+    string_view name(uint32_t atom) const { return names[atom]; }
+    uint32_t hashOf(uint32_t atom) const { return hashes[atom]; }
+    size_t size() const { return names.size(); }
+
+    // Makes room for count names without growing the table
+    void reserve(size_t count);
+
+    // Bytes held: arena chunks, slot table and per-atom arrays
+    size_t memoryUsage() const;
+
+private:
+    static constexpr uint32_t empty = UINT32_MAX;
+    static constexpr size_t chunkSize = 64 * 1024;
+
+    struct Slot {
+        uint32_t hash;
+        uint32_t atom;
+    };
+
+    vector<Slot> table;   // power-of-two size, at most half full
+    unsigned slotBits = 0;
+    vector<string_view> names;   // by atom, into chunks
+    vector<uint32_t> hashes;     // by atom, so growing never rehashes a name
+    vector<unique_ptr<char[]>> chunks;
+    size_t chunkUsed = chunkSize;  // bytes used in chunks.back()
+    size_t arenaBytes = 0;
+
+    size_t home(uint32_t hash) const { return size_t((hash * 0x9E3779B1u) >> (32 - slotBits)); }
+    void rehash(unsigned bits);
+    string_view copy(string_view name);
+};
+
+#endif // INTERNER_H
@@ -0,0 +1,106 @@
+#ifndef KEYWORDS_H
+#define KEYWORDS_H
+
+#include <array>
+#include <cstdint>
+#include <string_view>
+
+using namespace std;
+
+// Python keywords, in the same order as keywordNames below
+enum class Keyword : uint8_t {
+    False, None, True, And, As, Assert,
+    Async, Await, Break, Class, Continue,
+    Def, Del, Elif, Else, Except, Finally,
+    For, From, Global, If, Import, In,
+    Is, Lambda, Nonlocal, Not, Or, Pass,
+    Raise, Return, Try, While, With, Yield,
+    NotKeyword
+};
+
+inline constexpr array<string_view, size_t(Keyword::NotKeyword)> keywordNames = {
+    "False", "None", "True", "and", "as", "assert",
+    "async", "await", "break", "class", "continue",
+    "def", "del", "elif", "else", "except", "finally",
+    "for", "from", "global", "if", "import", "in",
+    "is", "lambda", "nonlocal", "not", "or", "pass",
+    "raise", "return", "try", "while", "with", "yield"
+};
+
+// Perfect hash over (first char, last char, length). Every keyword differs in
+// at least one of the three, so a multiplier that spreads them over the table
+// without collisions is searched for at compile time and each lookup costs one
+// multiply plus a single string compare.
+namespace keyword_hash {
+
+inline constexpr unsigned tableBits = 6;
+inline constexpr size_t tableSize = size_t(1) << tableBits;
+
+constexpr uint32_t key(string_view word) {
+    return (uint32_t(uint8_t(word.front())) << 16) |
+           (uint32_t(uint8_t(word.back())) << 8) |
+           uint32_t(word.size());
+}
+
+constexpr uint32_t slot(uint32_t key, uint32_t seed) {
+    return (key * seed) >> (32 - tableBits);
+}
+
+constexpr uint32_t findSeed() {
+    for (uint32_t seed = 0x9E3779B1u; seed != 0x9E3779B1u + 2000000u; seed += 2) {
+        uint64_t used = 0;
+        bool collision = false;
+        for (string_view name : keywordNames) {
+            uint64_t bit = uint64_t(1) << slot(key(name), seed);
+            if (used & bit) {
+                collision = true;
+                break;
+            }
+            used |= bit;
+        }
+        if (!collision) return seed;
+    }
+    return 0;
+}
+
+inline constexpr uint32_t seed = findSeed();
+static_assert(seed != 0, "no collision-free seed for the keyword table");
+
+constexpr array<Keyword, tableSize> buildTable() {
+    array<Keyword, tableSize> table{};
+    for (auto& entry : table) entry = Keyword::NotKeyword;
+    for (size_t i = 0; i < keywordNames.size(); ++i) {
+        table[slot(key(keywordNames[i]), seed)] = Keyword(i);
+    }
+    return table;
+}
+
+inline constexpr array<Keyword, tableSize> table = buildTable();
+
+} // namespace keyword_hash
+
+// Returns the keyword spelled by word, or Keyword::NotKeyword for identifiers
+constexpr Keyword lookupKeyword(string_view word) {
+    // Keywords are 2..8 characters long; anything else is an identifier
+    if (word.size() < 2 || word.size() > 8) return Keyword::NotKeyword;
+    Keyword candidate = keyword_hash::table[keyword_hash::slot(keyword_hash::key(word), keyword_hash::seed)];
+    if (candidate != Keyword::NotKeyword && keywordNames[size_t(candidate)] == word) {
+        return candidate;
+    }
+    return Keyword::NotKeyword;
+}
+
+namespace keyword_hash {
+
+constexpr bool tableIsConsistent() {
+    for (size_t i = 0; i < keywordNames.size(); ++i) {
+        if (lookupKeyword(keywordNames[i]) != Keyword(i)) return false;
+    }
+    return lookupKeyword("print") == Keyword::NotKeyword;
+}
+
+static_assert(tableIsConsistent(), "keyword table is inconsistent");
+
+} // namespace keyword_hash
+
+#endif // KEYWORDS_H
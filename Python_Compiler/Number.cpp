@@ -0,0 +1,81 @@
+#include "Number.h"
+#include <charconv>
+#include <cmath>
+
+BigInt BigInt::parse(string_view digits, int base) {
+    BigInt result;
+    // Multiply-add a chunk of digits at a time; 9 decimal digits (or 7 hex,
+    // 10 octal, 31 binary) still fit a limb
+    uint32_t chunkDigits = base == 10 ? 9 : base == 16 ? 7 : base == 8 ? 10 : 31;
+    size_t at = 0;
+    while (at < digits.size()) {
+        size_t count = min<size_t>(chunkDigits, digits.size() - at);
+        uint32_t chunk = 0, scale = 1;
+        for (size_t i = 0; i < count; ++i) {
+            char c = digits[at + i];
+            uint32_t digit = c <= '9' ? uint32_t(c - '0') : uint32_t((c | 0x20) - 'a' + 10);
+            chunk = chunk * uint32_t(base) + digit;
+            scale *= uint32_t(base);
+        }
+        at += count;
+
+        uint64_t carry = chunk;
+        for (uint32_t& limb : result.limbs) {
+            uint64_t product = uint64_t(limb) * scale + carry;
+            limb = uint32_t(product);
+            carry = product >> 32;
+        }
+        if (carry) result.limbs.push_back(uint32_t(carry));
+    }
+    return result;
+}
+
+double BigInt::toDouble() const {
+    if (limbs.empty()) return 0;
+    size_t top = limbs.size() - 1;
+    int topBits = 32;
+    while (!(limbs[top] >> (topBits - 1))) --topBits;
+    size_t bits = top * 32 + size_t(topBits);
+
+    // The leading 64 bits, with any bit below them folded into the last one
+    // so that the conversion to double still rounds correctly
+    uint64_t leading = 0;
+    bool sticky = false;
+    for (size_t i = limbs.size(); i-- > 0;) {
+        size_t low = i * 32;  // bit position of this limb
+        for (int b = 31; b >= 0; --b) {
+            size_t position = low + size_t(b);
+            if (position >= bits) continue;
+            bool bit = (limbs[i] >> b) & 1;
+            if (position + 64 >= bits) leading = (leading << 1) | uint64_t(bit);
+            else sticky |= bit;
+        }
+    }
+    if (sticky) leading |= 1;
+    int shift = bits > 64 ? int(bits - 64) : 0;
+    return ldexp(double(leading), shift);
+}
+
+double Number::toDouble() const {
+    switch (kind) {
+    case Kind::Int: return double(integer);
+    case Kind::BigInt: return big->toDouble();
+    case Kind::Float: return real;
+    }
+    return 0;
+}
+
+bool decodeNumber(string_view digits, int base, bool isFloat, Number& out) {
+    const char* first = digits.data();
+    const char* last = first + digits.size();
+    if (isFloat) {
+        out.kind = Number::Kind::Float;
+        out.real = 0;
+        // Out of a double's range: inf, or 0 for a tiny fraction, as in Python
+        if (from_chars(first, last, out.real).ec == errc::result_out_of_range) out.real = digits[0] == '0' ? 0.0 : HUGE_VAL;
+        return true;
+    }
+    out.kind = Number::Kind::Int;
+    out.integer = 0;
+    return from_chars(first, last, out.integer, base).ec != errc::result_out_of_range;
+}
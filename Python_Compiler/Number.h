@@ -0,0 +1,47 @@
+#ifndef NUMBER_H
+#define NUMBER_H
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+using namespace std;
+
+// An integer too large for int64_t, as base 2^32 limbs (least significant
+// first). Literals have no sign, so neither does this
+class BigInt {
+public:
+    // digits must be non-empty and valid for base (2, 8, 10 or 16)
+    static BigInt parse(string_view digits, int base);
+
+    // Nearest double; inf beyond its range
+    double toDouble() const;
+
+    size_t limbCount() const { return limbs.size(); }
+
+private:
+    vector<uint32_t> limbs;
+};
+
+// The value of a numeric literal, decoded once by the lexer. Big integers
+// live in the SourceBuffer the literal came from, like stored lexemes
+struct Number {
+    enum class Kind : uint8_t { Int, BigInt, Float };
+
+    Kind kind = Kind::Int;
+    union {
+        int64_t integer = 0;
+        double real;
+        const BigInt* big;
+    };
+
+    bool isInteger() const { return kind != Kind::Float; }
+    double toDouble() const;
+};
+
+// Decodes a literal the lexer has validated: digits in base 2, 8 or 16
+// without the prefix, or a decimal integer or float. Returns false when the
+// value needs a BigInt, which the caller then parses and stores
+bool decodeNumber(string_view digits, int base, bool isFloat, Number& out);
+
+#endif // NUMBER_H
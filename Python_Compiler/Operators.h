@@ -0,0 +1,89 @@
+#ifndef OPERATORS_H
+#define OPERATORS_H
+
+#include <array>
+#include <cstdint>
+#include "Token.h"
+
+using namespace std;
+
+// How tightly a binary operator binds, loosest first. All are left-associative
+enum class Precedence : uint8_t {
+    None, Or, And, Equality, Relational, Term, Factor
+};
+
+// The operators an expression can use, in the same order as operatorTable
+// below. and/or/not are keywords to the lexer and the rest Operator tokens;
+// operatorOf() maps both to one of these
+enum class OperatorKind : uint8_t {
+    None, Or, And, Not, Equal, NotEqual, Less, Greater, LessEqual, GreaterEqual,
+    Plus, Minus, Star, Slash, Percent
+};
+
+// What the expression parser needs to know about an operator. An operator
+// with no right operand is reported with missingRight; for and/or the
+// expression keeps what it had so far, for the rest it fails
+struct OperatorInfo {
+    Precedence binary;  // None: not a binary operator
+    bool prefix;        // also a unary operator (-, not)
+    bool keepsLeft;
+    string_view missingRight;
+};
+
+inline constexpr array<OperatorInfo, 15> operatorTable = {{
+    { Precedence::None, false, false, "" },
+    { Precedence::Or, false, true, "Expected right-hand expression after 'or'" },
+    { Precedence::And, false, true, "Expected right-hand expression after 'and'" },
+    { Precedence::None, true, false, "" },
+    { Precedence::Equality, false, false, "Expected right-hand expression after operator" },
+    { Precedence::Equality, false, false, "Expected right-hand expression after operator" },
+    { Precedence::Relational, false, false, "Expected right-hand expression after comparison" },
+    { Precedence::Relational, false, false, "Expected right-hand expression after comparison" },
+    { Precedence::Relational, false, false, "Expected right-hand expression after comparison" },
+    { Precedence::Relational, false, false, "Expected right-hand expression after comparison" },
+    { Precedence::Term, false, false, "Expected right-hand expression after operator" },
+    { Precedence::Term, true, false, "Expected right-hand expression after operator" },
+    { Precedence::Factor, false, false, "Expected right-hand expression after operator" },
+    { Precedence::Factor, false, false, "Expected right-hand expression after operator" },
+    { Precedence::Factor, false, false, "Expected right-hand expression after operator" },
+}};
+
+// The operator a token is, or None
+constexpr OperatorKind operatorOf(const Token& token) {
+    if (token.type == TokenType::Keyword) {
+        switch (token.keyword) {
+        case Keyword::Or: return OperatorKind::Or;
+        case Keyword::And: return OperatorKind::And;
+        case Keyword::Not: return OperatorKind::Not;
+        default: return OperatorKind::None;
+        }
+    }
+    if (token.type != TokenType::Operator || token.value.empty()) return OperatorKind::None;
+
+    // The lexer only joins a following '=' onto an operator
+    if (token.value.size() == 2) {
+        switch (token.value[0]) {
+        case '=': return OperatorKind::Equal;
+        case '!': return OperatorKind::NotEqual;
+        case '<': return OperatorKind::LessEqual;
+        case '>': return OperatorKind::GreaterEqual;
+        default: return OperatorKind::None;
+        }
+    }
+    switch (token.value[0]) {
+    case '<': return OperatorKind::Less;
+    case '>': return OperatorKind::Greater;
+    case '+': return OperatorKind::Plus;
+    case '-': return OperatorKind::Minus;
+    case '*': return OperatorKind::Star;
+    case '/': return OperatorKind::Slash;
+    case '%': return OperatorKind::Percent;
+    default: return OperatorKind::None;
+    }
+}
+
+inline constexpr const OperatorInfo& operatorInfo(OperatorKind kind) {
+    return operatorTable[size_t(kind)];
+}
+
+#endif // OPERATORS_H
@@ -0,0 +1,26 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Runs work(0) .. work(count - 1) on up to `threads` threads. Each thread
+// takes the next item as soon as it is done with one, so items of very
+// different cost even out without any scheduling up front
+template <class Work>
+void runParallel(size_t count, unsigned threads, Work work) {
+    atomic<size_t> next{0};
+    auto worker = [&] {
+        for (size_t i = next++; i < count; i = next++) work(i);
+    };
+    vector<thread> pool;
+    for (unsigned t = 1; t < threads && t < count; ++t) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
+
+#endif // PARALLEL_H
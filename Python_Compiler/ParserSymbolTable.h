@@ -1,177 +1,336 @@
 #ifndef PARSERSYMBOLTABLE_H
 #define PARSERSYMBOLTABLE_H
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <deque>
 #include <iostream>
 #include <string>
+#include <string_view>
 #include <vector>
-#include <unordered_map>
+#include <memory>
+#include "AST_Node.h"
+#include "Span.h"
+#include "SymbolTable.h"
 
 using namespace std;
 
+// Inferred types, in the same order as dataTypeNames below. Unknown is the
+// bottom: declare() only ever replaces it, never a type already inferred
+enum class DataType : uint8_t {
+    Unknown, Int, Float, String, Boolean, Expr, Function, Void
+};
+
+inline constexpr array<string_view, 8> dataTypeNames = {
+    "unknown", "int", "float", "string", "boolean", "expr", "function", "void"
+};
+
+enum class SymbolRole : uint8_t { Variable, Function, Parameter };
+
+inline constexpr array<string_view, 3> symbolRoleNames = { "variable", "function", "parameter" };
+
+// What opened a scope, in the same order as scopeKindNames below
+enum class ScopeKind : uint8_t { Global, If, Elif, Else, For, While, Function };
+
+inline constexpr array<string_view, 7> scopeKindNames = {
+    "global", "if block", "elif block", "else block", "for loop", "while block", "(function)"
+};
+
+// The constant a declaration is known to hold. Text views either the source
+// buffer (literals, names) or text the ParserSymbolTable stores for it
+struct SymbolValue {
+    enum class Kind : uint8_t { Unknown, Number, Boolean, Text };
+
+    Kind kind = Kind::Unknown;
+    uint32_t length = 0;  // Text only
+    union {
+        double number = 0;
+        bool boolean;
+        const char* text;
+    };
+
+    static SymbolValue ofNumber(double value) {
+        SymbolValue v;
+        v.kind = Kind::Number;
+        v.number = value;
+        return v;
+    }
+
+    static SymbolValue ofBoolean(bool value) {
+        SymbolValue v;
+        v.kind = Kind::Boolean;
+        v.boolean = value;
+        return v;
+    }
+
+    static SymbolValue ofText(string_view value) {
+        SymbolValue v;
+        v.kind = Kind::Text;
+        v.text = value.data();
+        v.length = uint32_t(value.size());
+        return v;
+    }
+
+    bool isKnown() const { return kind != Kind::Unknown; }
+    string_view textView() const { return kind == Kind::Text ? string_view(text, length) : string_view(); }
+
+    // Python-style spelling: numbers as to_string prints them, True/False,
+    // and "unknown" when nothing is known
+    string toString() const {
+        switch (kind) {
+        case Kind::Number: return to_string(number);
+        case Kind::Boolean: return boolean ? "True" : "False";
+        case Kind::Text: return string(text, length);
+        default: return "unknown";
+        }
+    }
+};
+
+// A declaration. atom is the lexer's symbol ID for the name (Token::symbolId),
+// and name a view of it in the shared SymbolTable. scope indexes the table's
+// scope tree (see ParserSymbolTable::scopeName). line and column are where
+// the name was first declared in that scope
 struct ParserSymbolTableEntry {
     int id;
-    string name;
-    string dataType;
-    string value;
-    string role;
-    string scope;  // Added to track scope information
+    int atom;
+    string_view name;
+    int scope;
+    int line, column;
+    DataType dataType;
+    SymbolRole role;
+    SymbolValue value;
 };
 
+// Scoped declarations on top of the lexer's SymbolTable. The lexer and the
+// parser share that one table, so names are only ever hashed by the lexer
+// and every lookup here is keyed on the atom a token already carries.
+//
+// Name resolution does not search the scopes. visible[atom] is the innermost
+// declaration of that name in scope, and each declaration remembers the one
+// it shadows, so the declarations of a name form a stack threaded through
+// the entries. Each scope logs the declarations it made; endScope() pops
+// just those, restoring whatever they shadowed.
+//
+// Every scope ever opened stays in a tree (scopes, by ID; 0 is global), so
+// entries can name theirs with an int after it has been closed, and it can
+// be opened again to parse part of it anew (reopenScope).
 class ParserSymbolTable {
 private:
-    unordered_map<string, vector<int>> nameToIds;
+    struct Binding {
+        int shadowed;  // entry visible under this name before, or -1
+        int depth;     // index of the declaring scope in openScopes
+    };
+
+    struct Scope {
+        int parent;    // -1 for global
+        int function;  // Function scopes: the function's entry ID; otherwise -1
+        ScopeKind kind;
+        vector<int> entries;  // declared in it, by ID
+    };
+
+    shared_ptr<const SymbolTable> atoms;
     vector<ParserSymbolTableEntry> entries;
-    vector<unordered_map<string, int>> scopes;
-    vector<string> scopeNames;
+    vector<Binding> bindings;      // by entry ID
+    vector<int> visible;           // by atom: entry ID, or -1
+    vector<int> declared;          // entry IDs in declaration order, undone by endScope
+    vector<size_t> scopeStarts;    // size of declared when each open scope began
+    vector<Scope> scopes;          // by scope ID
+    vector<int> openScopes;        // scope IDs, outermost first
+    deque<string> texts;           // stored values; deque: views stay valid
     int nextId;
 
 public:
-    ParserSymbolTable() : nextId(0) {
-        scopes.emplace_back(); // global scope
-        scopeNames.push_back("global");
+    explicit ParserSymbolTable(shared_ptr<const SymbolTable> atoms) : atoms(move(atoms)), nextId(0) {
+        scopeStarts.push_back(0); // global scope
+        scopes.push_back({-1, -1, ScopeKind::Global, {}});
+        openScopes.push_back(0);
     }
 
-    vector<ParserSymbolTableEntry> getEntries(){
+    // By ID; valid until the next declaration
+    Span<ParserSymbolTableEntry> getEntries() const {
         return entries;
     }
 
-    void beginScope(const string& scopeName = "") {
-        scopes.emplace_back();
-        scopeNames.push_back(scopeName);
+    // The atom for a name that did not come from a token, or -1 if the lexer never saw it
+    int atomOf(string_view name) const {
+        return atoms->find(name);
+    }
+
+    // Opens a scope inside the current one. function is the entry ID of the
+    // function whose body a Function scope is
+    void beginScope(ScopeKind kind, int function = -1) {
+        scopeStarts.push_back(declared.size());
+        scopes.push_back({openScopes.back(), function, kind, {}});
+        openScopes.push_back(int(scopes.size()) - 1);
+    }
+
+    // Opens a closed scope again, with its declarations visible as they were
+    // when it closed, so that declaring there again updates them instead of
+    // adding new entries. Its parent must be the current scope
+    void reopenScope(int scope) {
+        scopeStarts.push_back(declared.size());
+        openScopes.push_back(scope);
+        int depth = (int)openScopes.size() - 1;
+        for (int id : scopes[scope].entries) {
+            int atom = entries[id].atom;
+            bindings[id] = {visible[atom], depth};
+            visible[atom] = id;
+            declared.push_back(id);
+        }
+    }
+
+    // Reopens scope and the closed scopes around it, outermost first, so
+    // that part of it can be parsed again. Only the global scope may be
+    // open. Returns how many were opened, for as many endScope() calls
+    int reopenScopes(int scope) {
+        vector<int> chain;
+        for (; scope > 0; scope = scopes[scope].parent) chain.push_back(scope);
+        for (auto s = chain.rbegin(); s != chain.rend(); ++s) reopenScope(*s);
+        return int(chain.size());
     }
 
     void endScope() {
-        if (scopes.size() > 1) {
-            scopes.pop_back();
-            scopeNames.pop_back();
+        if (scopeStarts.size() > 1) {
+            for (size_t i = declared.size(); i > scopeStarts.back(); --i) {
+                int id = declared[i - 1];
+                visible[entries[id].atom] = bindings[id].shadowed;
+            }
+            declared.resize(scopeStarts.back());
+            scopeStarts.pop_back();
+            openScopes.pop_back();
         }
     }
 
-    string getCurrentScope() const {
-        return scopeNames.empty() ? "global" : scopeNames.back();
+    int getCurrentScope() const {
+        return openScopes.back();
+    }
+
+    // How many scopes are open inside the global one
+    size_t depth() const {
+        return openScopes.size() - 1;
     }
 
-    void declare(const string& name, const string& type, const string& role, const string& value = "unknown") {
-        if (scopes.empty()) {
-            scopes.emplace_back();
-            scopeNames.push_back("global");
+    // The entry ID of the function whose body is the current scope, or -1
+    int currentFunction() const {
+        return scopes[openScopes.back()].function;
+    }
+
+    // Names of the scope and those enclosing it, outermost first, joined by
+    // " > ": "global > f (function) > if block"
+    string scopePath(int scope) const {
+        string path = scopeName(scope);
+        for (int s = scopes[scope].parent; s >= 0; s = scopes[s].parent) {
+            path = scopeName(s) + " > " + path;
         }
-        auto& currentScope = scopes.back();
-        string currentScopeName = scopeNames.back();
+        return path;
+    }
+
+    // "global", "while block", "f (function)", ...
+    string scopeName(int scope) const {
+        const Scope& s = scopes[scope];
+        if (s.kind == ScopeKind::Function && s.function >= 0) {
+            return string(entries[s.function].name) + " " + string(scopeKindNames[size_t(s.kind)]);
+        }
+        return string(scopeKindNames[size_t(s.kind)]);
+    }
+
+    static string_view typeName(DataType type) { return dataTypeNames[size_t(type)]; }
+    static string_view roleName(SymbolRole role) { return symbolRoleNames[size_t(role)]; }
+
+    // A Text value for text that has no other home, such as a symbolic
+    // expression built by the parser. It lives as long as the table
+    SymbolValue store(string text) {
+        texts.push_back(move(text));
+        return SymbolValue::ofText(texts.back());
+    }
+
+    // Declares the identifier name in the current scope, or updates its
+    // declaration there. Returns the entry ID, or -1 if name is not an identifier
+    int declare(const Token& name, DataType type, SymbolRole role, SymbolValue value = {}) {
+        int atom = name.symbolId;
+        if (atom < 0) return -1;
+        if (atom >= (int)visible.size()) visible.resize(max(size_t(atom) + 1, atoms->getSymbolTable().size()), -1);
+        int depth = (int)openScopes.size() - 1;
 
         // Check if already declared in current scope
-        auto it = currentScope.find(name);
-        if (it != currentScope.end()) {
-            int id = it->second;
-            if (entries[id].dataType == "unknown") {
+        int id = visible[atom];
+        if (id >= 0 && bindings[id].depth == depth) {
+            if (entries[id].dataType == DataType::Unknown) {
                 entries[id].dataType = type;
             }
             entries[id].role = role;
-            if (value != "unknown") {
+            if (value.isKnown()) {
                 entries[id].value = value;
             }
-            return;
+            return id;
         }
 
-        // Check if exists in any scope
-        auto itAll = nameToIds.find(name);
-        int id;
-        if (itAll == nameToIds.end()) {
-            id = nextId++;
-            ParserSymbolTableEntry entry = {id, name, type, value, role, currentScopeName};
-            entries.push_back(entry);
-            nameToIds[name] = vector<int>{id};
-        } else {
-            id = nextId++;
-            ParserSymbolTableEntry entry = {id, name, type, value, role, currentScopeName};
-            entries.push_back(entry);
-            itAll->second.push_back(id);
-        }
-        currentScope[name] = id;
+        bindings.push_back({id, depth});
+        id = nextId++;
+        entries.push_back({id, atom, atoms->name(atom), openScopes.back(), name.line, name.column, type, role, value});
+        declared.push_back(id);
+        scopes[openScopes.back()].entries.push_back(id);
+        visible[atom] = id;
+        return id;
     }
 
-    void updateValue(const string& name, const string& value) {
-        for (int i = (int)scopes.size() - 1; i >= 0; --i) {
-            auto& scope = scopes[i];
-            auto sit = scope.find(name);
-            if (sit != scope.end()) {
-                int id = sit->second;
-                entries[id].value = value;
-                return;
+    // Copies the Text values that view text into the table, so they outlive
+    // an edit of it
+    void detachFrom(string_view text) {
+        for (auto& entry : entries) {
+            string_view value = entry.value.textView();
+            if (!value.empty() && value.data() >= text.data() && value.data() < text.data() + text.size()) {
+                entry.value = store(string(value));
             }
         }
     }
 
-    void updateType(const string& name, const string& type) {
-        for (int i = (int)scopes.size() - 1; i >= 0; --i) {
-            auto& scope = scopes[i];
-            auto sit = scope.find(name);
-            if (sit != scope.end()) {
-                int id = sit->second;
-                entries[id].dataType = type;
-                return;
-            }
-        }
+    void updateValue(int atom, SymbolValue value) {
+        if (auto entry = lookupEntry(atom)) entry->value = value;
+    }
+
+    void updateType(int atom, DataType type) {
+        if (auto entry = lookupEntry(atom)) entry->dataType = type;
     }
 
     void print() const {
         cout << "\nSymbol Table:\n";
         cout << "Scope hierarchy: ";
-        for (const auto& scope : scopeNames) {
-            cout << scope << " > ";
+        for (int scope : openScopes) {
+            cout << scopeName(scope) << " > ";
         }
         cout << "\n\n";
 
         for (const auto& entry : entries) {
             cout << "ID: " << entry.id
                  << ", Name: " << entry.name
-                 << ", Type: " << entry.dataType
-                 << ", Value: " << entry.value
-                 << ", Role: " << entry.role
-                 << ", Scope: " << entry.scope
+                 << ", Type: " << typeName(entry.dataType)
+                 << ", Value: " << entry.value.toString()
+                 << ", Role: " << roleName(entry.role)
+                 << ", Scope: " << scopeName(entry.scope)
                  << '\n';
         }
     }
 
-    int lookup(const string& name) const {
-        for (int i = (int)scopes.size() - 1; i >= 0; --i) {
-            const auto& scope = scopes[i];
-            auto it = scope.find(name);
-            if (it != scope.end()) {
-                return it->second;
-            }
-        }
-        return -1;
-    }
-
-    ParserSymbolTableEntry* lookupEntry(const string& name) {
-        for (int i = (int)scopes.size() - 1; i >= 0; --i) {
-            const auto& scope = scopes[i];
-            auto it = scope.find(name);
-            if (it != scope.end()) {
-                int id = it->second;
-                if (id >= 0 && id < (int)entries.size()) {
-                    return &entries[id];
-                }
-            }
-        }
-        return nullptr;
+    int lookup(int atom) const {
+        return atom >= 0 && atom < (int)visible.size() ? visible[atom] : -1;
+    }
+
+    ParserSymbolTableEntry* lookupEntry(int atom) {
+        int id = lookup(atom);
+        return id >= 0 ? &entries[id] : nullptr;
     }
 
     // Also add a const version for const contexts
-    const ParserSymbolTableEntry* lookupEntry(const string& name) const {
-        for (int i = (int)scopes.size() - 1; i >= 0; --i) {
-            const auto& scope = scopes[i];
-            auto it = scope.find(name);
-            if (it != scope.end()) {
-                int id = it->second;
-                if (id >= 0 && id < (int)entries.size()) {
-                    return &entries[id];
-                }
-            }
-        }
-        return nullptr;
+    const ParserSymbolTableEntry* lookupEntry(int atom) const {
+        int id = lookup(atom);
+        return id >= 0 ? &entries[id] : nullptr;
     }
+
+    // By entry ID, e.g. one returned by declare() or currentFunction()
+    ParserSymbolTableEntry& entry(int id) { return entries[id]; }
+    const ParserSymbolTableEntry& entry(int id) const { return entries[id]; }
 };
 
 #endif // PARSERSYMBOLTABLE_H
@@ -0,0 +1,79 @@
+#ifndef SOURCEBUFFER_H
+#define SOURCEBUFFER_H
+
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include "Number.h"
+
+using namespace std;
+
+// Holds the text being compiled. Token values are string_views into this
+// buffer, so it has to stay alive for as long as any token or AST node made
+// from it (the lexer, parser and controller share it through a shared_ptr).
+//
+// The text is either owned (the string constructor) or borrowed from memory
+// the caller already has, such as a memory-mapped file (borrow()). A borrowed
+// buffer never copies the text; it only holds on to whatever keeps it valid.
+class SourceBuffer {
+public:
+    explicit SourceBuffer(string text) : contents(move(text)), view(contents) {}
+
+    // Wraps text without copying it. keepAlive is released together with the
+    // buffer; pass nothing if the caller guarantees the text outlives it.
+    static shared_ptr<SourceBuffer> borrow(string_view text, shared_ptr<const void> keepAlive = nullptr) {
+        shared_ptr<SourceBuffer> buffer(new SourceBuffer(string()));
+        buffer->view = text;
+        buffer->backing = move(keepAlive);
+        return buffer;
+    }
+
+    SourceBuffer(const SourceBuffer&) = delete;
+    SourceBuffer& operator=(const SourceBuffer&) = delete;
+
+    string_view text() const { return view; }
+
+    size_t size() const { return view.size(); }
+
+    bool isBorrowed() const { return view.data() != contents.data(); }
+
+    // Replaces length bytes at offset with text, copying a borrowed buffer
+    // first. Views into the text are invalidated (token buffers hold offsets
+    // instead, so they only need shifting); views returned by store() stay valid
+    void replace(size_t offset, size_t length, string_view text) {
+        if (isBorrowed()) {
+            contents.assign(view);
+            backing.reset();
+        }
+        contents.replace(offset, length, text);
+        view = contents;
+    }
+
+    // Keeps a lexeme that does not exist verbatim in the source (error
+    // messages, rewritten literals) alive next to it and returns a view of it
+    // (lexers working on chunks of one buffer in parallel may call this at once)
+    string_view store(string value) {
+        lock_guard<mutex> lock(storeMutex);
+        owned.push_back(move(value));
+        return owned.back();
+    }
+
+    // The same for the value of an integer literal too big for a Number
+    const BigInt* store(BigInt value) {
+        lock_guard<mutex> lock(storeMutex);
+        bigInts.push_back(move(value));
+        return &bigInts.back();
+    }
+
+private:
+    string contents;              // empty when borrowed
+    string_view view;             // the text: contents, or the borrowed bytes
+    shared_ptr<const void> backing;
+    deque<string> owned;  // deque: element addresses stay stable on push_back
+    deque<BigInt> bigInts;
+    mutex storeMutex;
+};
+
+#endif // SOURCEBUFFER_H
@@ -0,0 +1,30 @@
+#ifndef SPAN_H
+#define SPAN_H
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// A read-only view of contiguous elements someone else owns (std::span is
+// C++20). Valid until the owner changes or is destroyed
+template <typename T>
+class Span {
+public:
+    Span() = default;
+    Span(const T* data, size_t count) : first(data), count(count) {}
+    Span(const vector<T>& items) : first(items.data()), count(items.size()) {}
+
+    const T* begin() const { return first; }
+    const T* end() const { return first + count; }
+    const T* data() const { return first; }
+    size_t size() const { return count; }
+    bool empty() const { return count == 0; }
+    const T& operator[](size_t index) const { return first[index]; }
+
+private:
+    const T* first = nullptr;
+    size_t count = 0;
+};
+
+#endif // SPAN_H
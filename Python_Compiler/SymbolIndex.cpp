@@ -0,0 +1,279 @@
+#include "SymbolIndex.h"
+#include <algorithm>
+#include <cstring>
+#include <tuple>
+
+namespace {
+
+size_t align8(size_t size) {
+    return (size + 7) & ~size_t(7);
+}
+
+// Byte offsets of the sections after the header, for the given counts
+struct Layout {
+    size_t files, names, definitions, references, texts, end;
+
+    explicit Layout(const SymbolIndex::Header& h) {
+        files = align8(sizeof(SymbolIndex::Header));
+        names = align8(files + h.fileCount * sizeof(SymbolIndex::File));
+        definitions = align8(names + h.nameCount * sizeof(SymbolIndex::Name));
+        references = align8(definitions + h.definitionCount * sizeof(SymbolIndex::Definition));
+        texts = align8(references + h.referenceCount * sizeof(SymbolIndex::Reference));
+        end = texts + h.textBytes;
+    }
+};
+
+// count records of type Record at offset in bytes
+template <typename Record>
+Span<Record> recordsAt(string_view bytes, size_t offset, uint32_t count) {
+    return Span<Record>(reinterpret_cast<const Record*>(bytes.data() + offset), count);
+}
+
+// Uses of names in the AST, skipping the names an assignment, def or for
+// loop binds (the symbol table has those)
+void collectReferences(const ASTNode* root, const TokenBuffer& tokens, vector<FileSymbols::Reference>& out) {
+    vector<const ASTNode*> pending{ root };  // children go on last first, to come off in order
+    while (!pending.empty()) {
+        const ASTNode* node = pending.back();
+        pending.pop_back();
+        if (!node) continue;
+        if (node->kind == NodeKind::Identifier) {
+            out.push_back({string(tokens.value(node->token)), tokens.line(node->token), tokens.column(node->token)});
+            continue;
+        }
+        bool bindsFirstChild = node->kind == NodeKind::Assign || node->kind == NodeKind::FunctionDef ||
+                               node->kind == NodeKind::For;
+        for (size_t i = node->children.size(); i > (bindsFirstChild ? 1 : 0); --i) {
+            pending.push_back(node->children[i - 1]);
+        }
+    }
+}
+
+} // namespace
+
+FileSymbols FileSymbols::collect(string path, const Compilation& compilation) {
+    FileSymbols file;
+    file.path = move(path);
+
+    const ParserSymbolTable& symbols = compilation.parserSymbols();
+    for (const auto& entry : symbols.getEntries()) {
+        file.definitions.push_back({string(entry.name), symbols.scopePath(entry.scope), entry.role,
+                                    entry.dataType, entry.line, entry.column});
+    }
+    collectReferences(compilation.ast(), compilation.tokens(), file.references);
+    return file;
+}
+
+shared_ptr<const SymbolIndex> SymbolIndex::open(string_view bytes, shared_ptr<const void> keepAlive) {
+    if (bytes.size() < sizeof(Header)) return nullptr;
+    const Header* header = reinterpret_cast<const Header*>(bytes.data());
+    if (memcmp(header->magic, magic, sizeof magic) != 0 || header->version != version) return nullptr;
+    Layout layout(*header);
+    if (layout.end > bytes.size()) return nullptr;
+
+    // Every index and string in the records must be in range, as queries
+    // and decode() use them unchecked; the bytes may be from anywhere
+    auto validText = [&](Text text) { return uint64_t(text.offset) + text.length <= header->textBytes; };
+    auto validRun = [](uint32_t first, uint32_t count, uint32_t total) { return uint64_t(first) + count <= total; };
+    for (const File& file : recordsAt<File>(bytes, layout.files, header->fileCount)) {
+        if (!validText(file.path)) return nullptr;
+    }
+    for (const Name& name : recordsAt<Name>(bytes, layout.names, header->nameCount)) {
+        if (!validText(name.text) ||
+            !validRun(name.firstDefinition, name.definitionCount, header->definitionCount) ||
+            !validRun(name.firstReference, name.referenceCount, header->referenceCount)) {
+            return nullptr;
+        }
+    }
+    for (const Definition& d : recordsAt<Definition>(bytes, layout.definitions, header->definitionCount)) {
+        if (d.name >= header->nameCount || d.file >= header->fileCount || !validText(d.scopePath) ||
+            size_t(d.role) >= symbolRoleNames.size() || size_t(d.type) >= dataTypeNames.size()) {
+            return nullptr;
+        }
+    }
+    for (const Reference& r : recordsAt<Reference>(bytes, layout.references, header->referenceCount)) {
+        if (r.name >= header->nameCount || r.file >= header->fileCount) return nullptr;
+    }
+
+    shared_ptr<SymbolIndex> index(new SymbolIndex());
+    index->backing = move(keepAlive);
+    index->header = header;
+    index->files = reinterpret_cast<const File*>(bytes.data() + layout.files);
+    index->names = reinterpret_cast<const Name*>(bytes.data() + layout.names);
+    index->allDefinitions = reinterpret_cast<const Definition*>(bytes.data() + layout.definitions);
+    index->allReferences = reinterpret_cast<const Reference*>(bytes.data() + layout.references);
+    index->texts = bytes.data() + layout.texts;
+    return index;
+}
+
+const SymbolIndex::Name* SymbolIndex::findName(string_view name) const {
+    const Name* end = names + header->nameCount;
+    const Name* found = lower_bound(names, end, name, [this](const Name& entry, string_view key) {
+        return text(entry.text) < key;
+    });
+    return found != end && text(found->text) == name ? found : nullptr;
+}
+
+Span<SymbolIndex::Definition> SymbolIndex::definitions(string_view name) const {
+    const Name* entry = findName(name);
+    if (!entry) return {};
+    return Span<Definition>(allDefinitions + entry->firstDefinition, entry->definitionCount);
+}
+
+Span<SymbolIndex::Reference> SymbolIndex::references(string_view name) const {
+    const Name* entry = findName(name);
+    if (!entry) return {};
+    return Span<Reference>(allReferences + entry->firstReference, entry->referenceCount);
+}
+
+vector<FileSymbols> SymbolIndex::decode() const {
+    vector<FileSymbols> result(header->fileCount);
+    for (uint32_t i = 0; i < header->fileCount; ++i) {
+        result[i].path = string(fileOf(i));
+    }
+    for (uint32_t i = 0; i < header->definitionCount; ++i) {
+        const Definition& d = allDefinitions[i];
+        result[d.file].definitions.push_back({string(nameOf(d.name)), string(text(d.scopePath)), d.role, d.type,
+                                              int(d.line), int(d.column)});
+    }
+    for (uint32_t i = 0; i < header->referenceCount; ++i) {
+        const Reference& r = allReferences[i];
+        result[r.file].references.push_back({string(nameOf(r.name)), int(r.line), int(r.column)});
+    }
+    return result;
+}
+
+void SymbolIndexWriter::update(FileSymbols file) {
+    removed.erase(file.path);
+    string path = file.path;
+    updated[path] = move(file);
+}
+
+void SymbolIndexWriter::remove(const string& path) {
+    updated.erase(path);
+    removed.insert(path);
+}
+
+string SymbolIndexWriter::bytes() const {
+    // The files to write, sorted by path so the same set gives the same bytes
+    vector<FileSymbols> kept = base ? base->decode() : vector<FileSymbols>();
+    kept.erase(remove_if(kept.begin(), kept.end(), [this](const FileSymbols& f) {
+                   return updated.count(f.path) || removed.count(f.path);
+               }), kept.end());
+    vector<const FileSymbols*> files;
+    for (const auto& f : kept) files.push_back(&f);
+    for (const auto& [path, f] : updated) files.push_back(&f);
+    sort(files.begin(), files.end(), [](const FileSymbols* a, const FileSymbols* b) { return a->path < b->path; });
+
+    string texts;
+    map<string_view, SymbolIndex::Text> textIds;  // keys view the FileSymbols
+    auto addText = [&](string_view s) {
+        auto [it, added] = textIds.emplace(s, SymbolIndex::Text{uint32_t(texts.size()), uint32_t(s.size())});
+        if (added) texts.append(s);
+        return it->second;
+    };
+
+    map<string_view, uint32_t> nameIds;
+    for (const FileSymbols* f : files) {
+        for (const auto& d : f->definitions) nameIds.emplace(d.name, 0);
+        for (const auto& r : f->references) nameIds.emplace(r.name, 0);
+    }
+    vector<SymbolIndex::Name> names;
+    for (auto& [name, id] : nameIds) {
+        id = uint32_t(names.size());
+        names.push_back({addText(name), 0, 0, 0, 0});
+    }
+
+    vector<SymbolIndex::File> fileRecords;
+    vector<pair<SymbolIndex::Definition, string_view>> scopedDefinitions;  // scope path added once sorted
+    vector<SymbolIndex::Reference> references;
+    for (uint32_t i = 0; i < files.size(); ++i) {
+        fileRecords.push_back({addText(files[i]->path)});
+        for (const auto& d : files[i]->definitions) {
+            scopedDefinitions.push_back({{nameIds[d.name], i, {}, uint32_t(d.line), uint32_t(d.column), d.role, d.type, 0},
+                                         d.scopePath});
+        }
+        for (const auto& r : files[i]->references) {
+            references.push_back({nameIds[r.name], i, uint32_t(r.line), uint32_t(r.column)});
+        }
+    }
+
+    // Group by name; each name's run is then a contiguous range. The order
+    // within a file is canonical too, so rewriting a decoded index gives the
+    // same bytes
+    auto key = [](const auto& x) { return tie(x.name, x.file, x.line, x.column); };
+    sort(scopedDefinitions.begin(), scopedDefinitions.end(),
+         [&](const auto& a, const auto& b) { return key(a.first) < key(b.first); });
+    sort(references.begin(), references.end(), [&](const auto& a, const auto& b) { return key(a) < key(b); });
+    vector<SymbolIndex::Definition> definitions;
+    for (auto& [d, scopePath] : scopedDefinitions) {
+        d.scopePath = addText(scopePath);
+        definitions.push_back(d);
+    }
+    for (uint32_t i = 0; i < definitions.size(); ++i) {
+        SymbolIndex::Name& name = names[definitions[i].name];
+        if (name.definitionCount++ == 0) name.firstDefinition = i;
+    }
+    for (uint32_t i = 0; i < references.size(); ++i) {
+        SymbolIndex::Name& name = names[references[i].name];
+        if (name.referenceCount++ == 0) name.firstReference = i;
+    }
+
+    SymbolIndex::Header header{};
+    memcpy(header.magic, SymbolIndex::magic, sizeof header.magic);
+    header.version = SymbolIndex::version;
+    header.fileCount = uint32_t(fileRecords.size());
+    header.nameCount = uint32_t(names.size());
+    header.definitionCount = uint32_t(definitions.size());
+    header.referenceCount = uint32_t(references.size());
+    header.textBytes = uint32_t(texts.size());
+
+    Layout layout(header);
+    string out(layout.end, '\0');
+    auto put = [&](size_t offset, const void* data, size_t size) {
+        if (size) memcpy(&out[offset], data, size);
+    };
+    put(0, &header, sizeof header);
+    put(layout.files, fileRecords.data(), fileRecords.size() * sizeof(SymbolIndex::File));
+    put(layout.names, names.data(), names.size() * sizeof(SymbolIndex::Name));
+    put(layout.definitions, definitions.data(), definitions.size() * sizeof(SymbolIndex::Definition));
+    put(layout.references, references.data(), references.size() * sizeof(SymbolIndex::Reference));
+    put(layout.texts, texts.data(), texts.size());
+    return out;
+}
+
+bool SymbolIndexSet::put(shared_ptr<const SymbolIndex> segment) {
+    if (!segment || segment->fileCount() != 1) return false;
+    remove(segment->fileOf(0));
+    auto it = segments.emplace(string(segment->fileOf(0)), move(segment)).first;
+    const SymbolIndex& added = *it->second;
+    for (uint32_t i = 0; i < added.nameCount(); ++i) {
+        directory[string(added.nameOf(i))].emplace(it->first, &added);
+    }
+    return true;
+}
+
+void SymbolIndexSet::remove(string_view path) {
+    auto it = segments.find(path);
+    if (it == segments.end()) return;
+    const SymbolIndex& old = *it->second;
+    for (uint32_t i = 0; i < old.nameCount(); ++i) {
+        auto entry = directory.find(old.nameOf(i));
+        entry->second.erase(it->first);
+        if (entry->second.empty()) directory.erase(entry);
+    }
+    segments.erase(it);
+}
+
+void SymbolIndexSet::clear() {
+    directory.clear();
+    segments.clear();
+}
+
+vector<const SymbolIndex*> SymbolIndexSet::segmentsWith(string_view name) const {
+    vector<const SymbolIndex*> found;
+    auto entry = directory.find(name);
+    if (entry == directory.end()) return found;
+    for (const auto& [path, segment] : entry->second) found.push_back(segment);
+    return found;
+}
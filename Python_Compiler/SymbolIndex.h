@@ -0,0 +1,161 @@
+#ifndef SYMBOLINDEX_H
+#define SYMBOLINDEX_H
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "Compilation.h"
+#include "Span.h"
+
+using namespace std;
+
+// What one file contributes to a SymbolIndex: every declaration in its
+// parser symbol table, and every other use of a name in its AST
+struct FileSymbols {
+    struct Definition {
+        string name;
+        string scopePath;  // ParserSymbolTable::scopePath
+        SymbolRole role;
+        DataType type;
+        int line, column;
+    };
+    struct Reference {
+        string name;
+        int line, column;
+    };
+
+    string path;
+    vector<Definition> definitions;
+    vector<Reference> references;
+
+    // Collects a parsed file's symbols; the compilation must still have its AST
+    static FileSymbols collect(string path, const Compilation& compilation);
+};
+
+// A project-wide index of where names are defined and used, answering
+// queries straight from its serialized bytes, which are meant to be
+// memory-mapped. Nothing is parsed or decoded when it is opened.
+//
+// Layout (all integers little-endian, every section 8-byte aligned):
+//   Header
+//   File[fileCount]              path
+//   Name[nameCount]              sorted by text; its definitions and
+//                                references are contiguous runs of:
+//   Definition[definitionCount]  ordered by name, file, line, column
+//   Reference[referenceCount]    likewise
+//   char[textBytes]              paths, names and scope paths
+// Strings are (offset into the text, length) pairs. An index is written
+// whole by SymbolIndexWriter; SymbolIndexSet keeps one per source file so
+// that an update only rewrites that file's.
+class SymbolIndex {
+public:
+    struct Text { uint32_t offset, length; };
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t fileCount, nameCount, definitionCount, referenceCount, textBytes;
+    };
+    struct File { Text path; };
+    struct Name {
+        Text text;
+        uint32_t firstDefinition, definitionCount;
+        uint32_t firstReference, referenceCount;
+    };
+    struct Definition {
+        uint32_t name, file;
+        Text scopePath;
+        uint32_t line, column;
+        SymbolRole role;
+        DataType type;
+        uint16_t reserved;
+    };
+    struct Reference {
+        uint32_t name, file;
+        uint32_t line, column;
+    };
+
+    static constexpr char magic[8] = {'C', 'o', 'm', 'P', 'y', 'I', 'd', 'x'};
+    static constexpr uint32_t version = 1;
+
+    // Reads an index from bytes, usually a mapped file that keepAlive holds
+    // open. Returns null if they are not an index of this version, or if
+    // any record in them points outside its section
+    static shared_ptr<const SymbolIndex> open(string_view bytes, shared_ptr<const void> keepAlive = nullptr);
+
+    // Where name is defined / used, across all files; empty if nowhere
+    Span<Definition> definitions(string_view name) const;
+    Span<Reference> references(string_view name) const;
+
+    string_view text(Text text) const { return string_view(texts + text.offset, text.length); }
+    string_view nameOf(uint32_t name) const { return text(names[name].text); }
+    string_view fileOf(uint32_t file) const { return text(files[file].path); }
+
+    size_t fileCount() const { return header->fileCount; }
+    size_t nameCount() const { return header->nameCount; }
+
+    // Decodes everything back into per-file form, in file order
+    vector<FileSymbols> decode() const;
+
+private:
+    SymbolIndex() = default;
+
+    const Name* findName(string_view name) const;
+
+    shared_ptr<const void> backing;
+    const Header* header = nullptr;
+    const File* files = nullptr;
+    const Name* names = nullptr;
+    const Definition* allDefinitions = nullptr;
+    const Reference* allReferences = nullptr;
+    const char* texts = nullptr;
+};
+
+// Builds the bytes of a SymbolIndex: the files of an existing index (if
+// any), with some of them replaced or removed
+class SymbolIndexWriter {
+public:
+    explicit SymbolIndexWriter(shared_ptr<const SymbolIndex> base = nullptr) : base(move(base)) {}
+
+    // Adds a file, replacing whatever the index had for its path
+    void update(FileSymbols file);
+
+    void remove(const string& path);
+
+    string bytes() const;
+
+private:
+    shared_ptr<const SymbolIndex> base;
+    map<string, FileSymbols> updated;
+    set<string> removed;
+};
+
+// The symbol index of a directory as segments: one SymbolIndex per source
+// file, each written on its own, and a name directory saying which
+// segments define or use each name. Replacing a segment costs time in
+// proportion to that file; a query searches only the segments its name is
+// in. The directory lives in memory and is rebuilt as segments are added
+class SymbolIndexSet {
+public:
+    // Makes segment the one for the file it indexes, replacing what that
+    // file had. Returns false, changing nothing, unless it has exactly one
+    bool put(shared_ptr<const SymbolIndex> segment);
+
+    void remove(string_view path);
+    void clear();
+
+    // The segments where name is defined or used, by path
+    vector<const SymbolIndex*> segmentsWith(string_view name) const;
+
+    size_t size() const { return segments.size(); }
+
+private:
+    map<string, shared_ptr<const SymbolIndex>, less<>> segments;  // by path
+    map<string, map<string_view, const SymbolIndex*>, less<>> directory;  // name -> its segments by path
+};
+
+#endif // SYMBOLINDEX_H
@@ -4,13 +4,12 @@ SymbolTable::SymbolTable(QObject *parent)
     : QObject{parent}
 {}
 
-int SymbolTable::insert(const string &name, const string &dataType, const string &value) {
-    if (nameToId.find(name) == nameToId.end()) {
-        nameToId[name] = nextId;
-        entries.push_back({ nextId, name, dataType, value });
-        return nextId++;
+int SymbolTable::insert(string_view name, uint32_t hash) {
+    uint32_t atom = names.intern(name, hash);
+    if (atom == entries.size()) {
+        entries.push_back({ int(atom), names.name(atom), "unknown", "unknown" });
     }
-    return nameToId[name];
+    return int(atom);
 }
 
 void SymbolTable::print() const {
@@ -21,20 +20,36 @@ void SymbolTable::print() const {
     }
 }
 
-void SymbolTable::updateType(const string &name, const string &type, const string &value) {
-    auto it = nameToId.find(name);
-    if (it != nameToId.end()) {
-        int index = it->second;
-        if (entries[index].dataType == "unknown")
-            entries[index].dataType = type;
-        if (entries[index].value == "unknown" && value != "unknown")
-            entries[index].value = value;
+void SymbolTable::updateType(string_view name, const string &type, const string &value) {
+    int id = names.find(name);
+    if (id >= 0) {
+        updateType(id, type, value);
     }
 }
 
+void SymbolTable::updateType(int id, const string &type, const string &value) {
+    if (id < 0 || id >= (int)entries.size()) return;
+    if (entries[id].dataType == "unknown")
+        entries[id].dataType = type;
+    if (entries[id].value == "unknown" && value != "unknown")
+        entries[id].value = value;
+}
+
 
 
-std::vector<SymbolTableEntry> SymbolTable::getSymbolTable()
+void SymbolTable::resetTypes() {
+    for (auto& entry : entries) {
+        entry.dataType = "unknown";
+        entry.value = "unknown";
+    }
+}
+
+const std::vector<SymbolTableEntry>& SymbolTable::getSymbolTable() const
 {
     return entries;
 }
+
+void SymbolTable::reserve(size_t count) {
+    names.reserve(count);
+    entries.reserve(count);
+}
@@ -3,13 +3,15 @@
 
 #include <QObject>
 #include <iostream>
+#include "Interner.h"
 using namespace std;
 
 
-// Entry in the symbol table for identifiers
+// Entry in the symbol table for identifiers. name views the table's
+// interner, so it is valid for as long as the table
 struct SymbolTableEntry {
     int id;
-    string name;
+    string_view name;
     string dataType;
     string value;
 };
@@ -20,20 +22,39 @@ class SymbolTable : public QObject
 public:
     explicit SymbolTable(QObject *parent = nullptr);
 
-    // Inserts a new identifier or returns its existing ID
-    int insert(const string& name, const string& dataType = "unknown", const string& value = "unknown");
+    // Inserts a new identifier or returns its existing ID. IDs are the
+    // interner's atoms. hash must be Interner::hash(name)
+    int insert(string_view name, uint32_t hash);
+    int insert(string_view name) { return insert(name, Interner::hash(name)); }
+
+    // The hash of a symbol's name, e.g. to insert it into another table
+    uint32_t hashOf(int id) const { return names.hashOf(uint32_t(id)); }
+
+    // The ID of a name, or -1 if it was never inserted
+    int find(string_view name) const { return names.find(name); }
+
+    // Valid for as long as the table
+    string_view name(int id) const { return names.name(uint32_t(id)); }
 
     // Prints the entire symbol table
     void print() const;
 
-    void updateType(const string& name, const string& type, const string& value = "unknown");
+    void updateType(string_view name, const string& type, const string& value = "unknown");
+
+    // Same as above for an ID returned by insert(), without hashing the name again
+    void updateType(int id, const string& type, const string& value = "unknown");
+
+    // Sets every type and value back to "unknown"; IDs and names are kept
+    void resetTypes();
+
+    const std::vector<SymbolTableEntry>& getSymbolTable() const;
 
-    std::vector<SymbolTableEntry> getSymbolTable();
+    // Makes room for count symbols in total
+    void reserve(size_t count);
 
 private:
-    std::unordered_map<std::string, int> nameToId;
-    std::vector<SymbolTableEntry> entries;
-    int nextId = 0;
+    Interner names;
+    std::vector<SymbolTableEntry> entries;  // by ID
 
 
 signals:
@@ -0,0 +1,32 @@
+#ifndef TOKEN_H
+#define TOKEN_H
+
+#include <cstdint>
+#include <string_view>
+#include "Keywords.h"
+#include "Number.h"
+
+using namespace std;
+
+// Token types recognized by the lexer. Newline ends every line that has
+// tokens; Indent and Dedent open and close blocks, as in CPython
+enum class TokenType {
+    Keyword, Identifier, Number, String, Operator, Delimiter,
+    Assignment, Boolean, Arithmetic, EOFToken, Error, Indent,
+    Dedent, Newline
+};
+
+// Represents a single token. value is a view into the lexer's SourceBuffer
+// (or into text the buffer stores on the lexer's behalf), never an owned copy
+struct Token {
+    TokenType type;
+    string_view value;
+    int line, column;
+    int symbolId = -1;  // Only used for identifiers
+    Keyword keyword = Keyword::NotKeyword;  // Only used for keywords
+    uint32_t offset = 0;  // Byte offset of the token's first character in the source
+    int indent = 0;  // Indent/Dedent: indentation width of the line they start (a tab counts 4)
+    Number number = {};  // Only used for numbers
+};
+
+#endif // TOKEN_H
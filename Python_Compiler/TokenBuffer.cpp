@@ -0,0 +1,322 @@
+#include "TokenBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+void TokenBuffer::pushKind(TokenType type) {
+    if (kinds.size() % rankBlock == 0) ranks.push_back({ uint32_t(symbolIds.size()), uint32_t(numbers.size()) });
+    kinds.push_back(uint8_t(type));
+}
+
+void TokenBuffer::append(const Token& token) {
+    string_view text = source->text();
+    const char* at = token.value.data();
+    bool inSource = at >= text.data() && at <= text.data() + text.size();
+    uint32_t length = uint32_t(token.value.size());
+
+    pushKind(token.type);
+    switch (token.type) {
+    case TokenType::Identifier:
+        symbolIds.push_back(token.symbolId);
+        break;
+    case TokenType::Number:
+        numbers.push_back(token.number);
+        break;
+    case TokenType::Keyword:
+        length = uint32_t(token.keyword);
+        break;
+    case TokenType::Indent:
+    case TokenType::Dedent:
+        length = uint32_t(token.indent);
+        break;
+    case TokenType::String:
+        // From the opening to the closing quotes. Only "" has no view into the source
+        if (inSource) {
+            size_t quotes = size_t(at - (text.data() + token.offset));
+            length = uint32_t(token.value.size() + 2 * quotes);
+        } else {
+            length = 2;
+        }
+        break;
+    case TokenType::Error:
+        if (!inSource) {
+            length = storedValue | uint32_t(storedValues.size());
+            storedValues.push_back(token.value);
+        }
+        break;
+    case TokenType::EOFToken:
+        length = 0;
+        break;
+    default:
+        break;
+    }
+    offsets.push_back(token.offset);
+    lengths.push_back(length);
+}
+
+void TokenBuffer::append(const TokenBuffer& piece, const vector<int>& pieceIds) {
+    size_t first = kinds.size();
+    uint32_t storedBase = uint32_t(storedValues.size());
+
+    kinds.insert(kinds.end(), piece.kinds.begin(), piece.kinds.end());
+    offsets.insert(offsets.end(), piece.offsets.begin(), piece.offsets.end());
+    lengths.insert(lengths.end(), piece.lengths.begin(), piece.lengths.end());
+    for (size_t i = first; i < kinds.size(); ++i) {
+        if (kinds[i] == uint8_t(TokenType::Error) && (lengths[i] & storedValue)) lengths[i] += storedBase;
+    }
+
+    symbolIds.reserve(symbolIds.size() + piece.symbolIds.size());
+    for (int id : piece.symbolIds) symbolIds.push_back(pieceIds[id]);
+    numbers.insert(numbers.end(), piece.numbers.begin(), piece.numbers.end());
+    storedValues.insert(storedValues.end(), piece.storedValues.begin(), piece.storedValues.end());
+    rebuildRanks(first);
+}
+
+void TokenBuffer::reserve(size_t count) {
+    kinds.reserve(count);
+    offsets.reserve(count);
+    lengths.reserve(count);
+    ranks.reserve(count / rankBlock + 1);
+}
+
+void TokenBuffer::dropBefore(size_t index) {
+    size_t blocks = (index - dropped) / rankBlock;
+    size_t count = blocks * rankBlock;
+    if (count < minDrop || count < kinds.size() - count) return;
+
+    size_t ids = identifiersBefore(count);
+    size_t numberCount = numbersBefore(count);
+    kinds.erase(kinds.begin(), kinds.begin() + count);
+    offsets.erase(offsets.begin(), offsets.begin() + count);
+    lengths.erase(lengths.begin(), lengths.begin() + count);
+    symbolIds.erase(symbolIds.begin(), symbolIds.begin() + ids);
+    numbers.erase(numbers.begin(), numbers.begin() + numberCount);
+    ranks.erase(ranks.begin(), ranks.begin() + blocks);
+    for (Rank& rank : ranks) {
+        rank.identifiers -= uint32_t(ids);
+        rank.numbers -= uint32_t(numberCount);
+    }
+    dropped += count;
+}
+
+void TokenBuffer::truncate(size_t count) {
+    if (count >= size()) return;
+    symbolIds.resize(identifiersBefore(count));
+    numbers.resize(numbersBefore(count));
+    kinds.resize(count);
+    offsets.resize(count);
+    lengths.resize(count);
+    ranks.resize((count + rankBlock - 1) / rankBlock);
+}
+
+template <class T>
+static void replaceRange(vector<T>& items, size_t first, size_t last, const vector<T>& with) {
+    auto at = items.erase(items.begin() + first, items.begin() + last);
+    items.insert(at, with.begin(), with.end());
+}
+
+void TokenBuffer::splice(size_t first, size_t last, const TokenBuffer& with, ptrdiff_t delta) {
+    size_t idFirst = identifiersBefore(first);
+    size_t idLast = identifiersBefore(last);
+    size_t numberFirst = numbersBefore(first);
+    size_t numberLast = numbersBefore(last);
+
+    for (size_t i = last; i < size(); ++i) offsets[i] = uint32_t(ptrdiff_t(offsets[i]) + delta);
+
+    auto isStored = [](const TokenBuffer& buffer, size_t i) {
+        return buffer.kinds[i] == uint8_t(TokenType::Error) && (buffer.lengths[i] & storedValue);
+    };
+    bool replacesStored = false;
+    for (size_t i = first; i < last && !replacesStored; ++i) replacesStored = isStored(*this, i);
+
+    vector<uint32_t> withLengths = with.lengths;
+    uint32_t storedBase = uint32_t(storedValues.size());
+    for (size_t i = 0; i < with.size(); ++i) {
+        if (isStored(with, i)) withLengths[i] += storedBase;
+    }
+    storedValues.insert(storedValues.end(), with.storedValues.begin(), with.storedValues.end());
+
+    replaceRange(kinds, first, last, with.kinds);
+    replaceRange(offsets, first, last, with.offsets);
+    replaceRange(lengths, first, last, withLengths);
+    replaceRange(symbolIds, idFirst, idLast, with.symbolIds);
+    replaceRange(numbers, numberFirst, numberLast, with.numbers);
+    rebuildRanks(first);
+
+    // Renumber the stored values still in use, so replaced ones do not pile up over edits
+    if (replacesStored) {
+        vector<string_view> kept;
+        for (size_t i = 0; i < kinds.size(); ++i) {
+            if (!isStored(*this, i)) continue;
+            kept.push_back(storedValues[lengths[i] & ~storedValue]);
+            lengths[i] = storedValue | uint32_t(kept.size() - 1);
+        }
+        storedValues = move(kept);
+    }
+}
+
+void TokenBuffer::rebuildRanks(size_t fromToken) {
+    // Blocks that start at or before fromToken keep their counts
+    size_t block = fromToken / rankBlock;
+    Rank count{ 0, 0 };
+    auto add = [&](size_t i) {
+        count.identifiers += kinds[i] == uint8_t(TokenType::Identifier);
+        count.numbers += kinds[i] == uint8_t(TokenType::Number);
+    };
+    if (block > 0) {
+        count = ranks[block - 1];
+        for (size_t i = (block - 1) * rankBlock; i < block * rankBlock; ++i) add(i);
+    }
+    ranks.resize(block);
+    for (size_t i = block * rankBlock; i < kinds.size(); ++i) {
+        if (i % rankBlock == 0) ranks.push_back(count);
+        add(i);
+    }
+}
+
+size_t TokenBuffer::countBefore(size_t index, TokenType kind, uint32_t Rank::*counted) const {
+    size_t block = index / rankBlock;
+    if (block >= ranks.size()) return kind == TokenType::Identifier ? symbolIds.size() : numbers.size();
+    size_t count = ranks[block].*counted;
+    for (size_t i = block * rankBlock; i < index; ++i) count += kinds[i] == uint8_t(kind);
+    return count;
+}
+
+const vector<uint32_t>& TokenBuffer::lines() const {
+    if (lineStarts.empty()) {
+        string_view text = source->text();
+        const char* begin = text.data();
+        const char* end = begin + text.size();
+        lineStarts.push_back(0);
+        for (const char* p = begin; p < end; ++p) {
+            p = static_cast<const char*>(memchr(p, '\n', size_t(end - p)));
+            if (!p) break;
+            lineStarts.push_back(uint32_t(p + 1 - begin));
+        }
+    }
+    return lineStarts;
+}
+
+void TokenBuffer::editLines(size_t offset, size_t length, string_view text) {
+    if (lineStarts.empty()) return;  // built from the edited text when needed
+    ptrdiff_t delta = ptrdiff_t(text.size()) - ptrdiff_t(length);
+
+    // Lines that started inside the replaced range are gone
+    auto first = upper_bound(lineStarts.begin(), lineStarts.end(), offset);
+    auto last = upper_bound(first, lineStarts.end(), offset + length);
+    for (auto it = last; it != lineStarts.end(); ++it) *it = uint32_t(ptrdiff_t(*it) + delta);
+
+    vector<uint32_t> added;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\n') added.push_back(uint32_t(offset + i + 1));
+    }
+    auto at = lineStarts.erase(first, last);
+    lineStarts.insert(at, added.begin(), added.end());
+}
+
+bool TokenBuffer::sameToken(size_t index, const TokenBuffer& other, size_t otherIndex, ptrdiff_t delta) const {
+    if (kinds[index] != other.kinds[otherIndex] || ptrdiff_t(offsets[index]) + delta != ptrdiff_t(other.offsets[otherIndex])) {
+        return false;
+    }
+    if (type(index) == TokenType::Error && ((lengths[index] | other.lengths[otherIndex]) & storedValue)) {
+        return value(index) == other.value(otherIndex);
+    }
+    return lengths[index] == other.lengths[otherIndex];
+}
+
+int TokenBuffer::lineOf(size_t offset) const {
+    const vector<uint32_t>& starts = lines();
+    return int(upper_bound(starts.begin(), starts.end(), offset) - starts.begin());
+}
+
+int TokenBuffer::column(size_t index) const {
+    return int(offset(index) - lineStart(line(index))) + 1;
+}
+
+string_view TokenBuffer::value(size_t index) const {
+    uint32_t length = lengths[index - dropped];
+    switch (type(index)) {
+    case TokenType::Keyword:
+        return keywordNames[length];
+    case TokenType::Indent:
+    case TokenType::Dedent:
+        return string_view();
+    case TokenType::EOFToken:
+        return "EOF";
+    case TokenType::Error:
+        if (length & storedValue) return storedValues[length & ~storedValue];
+        break;
+    case TokenType::String: {
+        // A single-quoted string never starts with three quotes ("" ends it)
+        string_view quoted = source->text().substr(offset(index), length);
+        size_t quotes = quoted.size() >= 6 && quoted.substr(0, 3) == "\"\"\"" ? 3 : 1;
+        return quoted.substr(quotes, quoted.size() - 2 * quotes);
+    }
+    default:
+        break;
+    }
+    return source->text().substr(offset(index), length);
+}
+
+int TokenBuffer::symbolId(size_t index) const {
+    if (type(index) != TokenType::Identifier) return -1;
+    return symbolIds[identifiersBefore(index - dropped)];
+}
+
+int TokenBuffer::indent(size_t index) const {
+    TokenType kind = type(index);
+    return kind == TokenType::Indent || kind == TokenType::Dedent ? int(lengths[index - dropped]) : 0;
+}
+
+Number TokenBuffer::number(size_t index) const {
+    if (type(index) != TokenType::Number) return Number();
+    return numbers[numbersBefore(index - dropped)];
+}
+
+Keyword TokenBuffer::keyword(size_t index) const {
+    return type(index) == TokenType::Keyword ? Keyword(lengths[index - dropped]) : Keyword::NotKeyword;
+}
+
+Token TokenBuffer::decode(size_t index, int line, int symbolId) const {
+    int column = int(offset(index) - lineStarts[line - 1]) + 1;
+    return { type(index), value(index), line, column, symbolId, keyword(index), offset(index), indent(index), number(index) };
+}
+
+Token TokenBuffer::token(size_t index) const {
+    return decode(index, line(index), symbolId(index));
+}
+
+size_t TokenBuffer::memoryUsage() const {
+    return kinds.size() * sizeof(uint8_t) + offsets.size() * sizeof(uint32_t) +
+           lengths.size() * sizeof(uint32_t) + symbolIds.size() * sizeof(int) +
+           numbers.size() * sizeof(Number) + ranks.size() * sizeof(Rank) +
+           storedValues.size() * sizeof(string_view);
+}
+
+TokenBuffer::Reader::Reader(const TokenBuffer& buffer, size_t from)
+    : buffer(buffer), lineStarts(buffer.lines()), text(buffer.source->text()), index(from) {
+    if (from == 0) return;
+    identifiers = buffer.identifiersBefore(from - buffer.dropped);
+    numbers = buffer.numbersBefore(from - buffer.dropped);
+    if (from < buffer.size()) line = size_t(buffer.lineOf(buffer.offset(from)) - 1);
+}
+
+Token TokenBuffer::Reader::next() {
+    size_t i = index++;
+    uint32_t at = buffer.offset(i);
+    while (line + 1 < lineStarts.size() && lineStarts[line + 1] <= at) ++line;
+    int column = int(at - lineStarts[line]) + 1;
+
+    // Most tokens are plain slices of the source; leave the rest to value()
+    TokenType kind = buffer.type(i);
+    switch (kind) {
+    case TokenType::Identifier:
+        return { kind, text.substr(at, buffer.lengths[i - buffer.dropped]), int(line) + 1, column, buffer.symbolIds[identifiers++], Keyword::NotKeyword, at };
+    case TokenType::Number:
+        return { kind, text.substr(at, buffer.lengths[i - buffer.dropped]), int(line) + 1, column, -1, Keyword::NotKeyword, at, 0, buffer.numbers[numbers++] };
+    case TokenType::Operator:
+    case TokenType::Delimiter:
+        return { kind, text.substr(at, buffer.lengths[i - buffer.dropped]), int(line) + 1, column, -1, Keyword::NotKeyword, at };
+    default:
+        return { kind, buffer.value(i), int(line) + 1, column, -1, buffer.keyword(i), at, buffer.indent(i) };
+    }
+}
@@ -0,0 +1,191 @@
+#ifndef TOKENBUFFER_H
+#define TOKENBUFFER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "SourceBuffer.h"
+#include "Token.h"
+
+using namespace std;
+
+class TokenBuffer;
+
+// A token inside a TokenBuffer: the buffer and an index, decoded on access.
+// Valid while the buffer is alive and not edited
+class TokenRef {
+public:
+    TokenRef(const TokenBuffer* buffer, size_t index) : buffer(buffer), index(uint32_t(index)) {}
+
+    TokenType type() const;
+    string_view value() const;
+    int line() const;
+    int column() const;
+    int symbolId() const;   // -1 unless an identifier
+    Keyword keyword() const;
+    int indent() const;
+    Number number() const;
+    uint32_t offset() const;
+
+    // A standalone copy, e.g. for an AST node
+    Token token() const;
+
+private:
+    const TokenBuffer* buffer;
+    uint32_t index;
+};
+
+// The tokens of one SourceBuffer in structure-of-arrays form. Per token there
+// is a kind byte, the byte offset of its first character and the length of
+// the source text it covers (9 bytes). Everything else is derived:
+//   value      that text; string contents without the quotes, or a message
+//              the lexer stored for some Errors
+//   keyword    kept in the length slot, since the keyword implies its length;
+//              so is the width of Indent and Dedent, which cover no text
+//   symbol ID  kept in a side array with one entry per identifier, found
+//              through the identifier count at every 64th token
+//   number     the decoded value of a Number, likewise
+//   line, col  from a table of line starts, built the first time it is needed
+// Offsets are 32-bit, so sources are limited to 4 GiB.
+//
+// Tokens can be dropped from the front once nothing will look them up again
+// (dropBefore); indices stay those of the whole token sequence.
+class TokenBuffer {
+public:
+    class Reader;
+
+    TokenBuffer() = default;
+    explicit TokenBuffer(shared_ptr<const SourceBuffer> source) : source(move(source)) {}
+
+    // Appends a token produced by a Lexer over this buffer's source
+    void append(const Token& token);
+
+    // Appends all of pieces's tokens (same source), giving identifier i the
+    // symbol ID symbolIds[i]; used to join the pieces of a parallel lex
+    void append(const TokenBuffer& piece, const vector<int>& symbolIds);
+
+    void reserve(size_t count);
+
+    // Lets the tokens before index go. They are freed in whole rank blocks,
+    // and only once they are at least as many as the tokens held after them,
+    // so the rest is moved down about once per token; up to that, they can
+    // still be looked up. truncate, splice and sameToken take buffers that
+    // have dropped nothing
+    void dropBefore(size_t index);
+
+    // Index of the first token still held
+    size_t firstHeld() const { return dropped; }
+
+    // Drops every token from index count on
+    void truncate(size_t count);
+
+    // Replaces tokens [first, last) with the tokens of `with` (lexed from the
+    // edited source) and moves the ones after them by delta bytes
+    void splice(size_t first, size_t last, const TokenBuffer& with, ptrdiff_t delta);
+
+    // Keeps the line table in step with an edit of the source that replaced
+    // length bytes at offset with text
+    void editLines(size_t offset, size_t length, string_view text);
+
+    // Whether token index is the same as token otherIndex of other, lexed
+    // from this buffer's source after an edit moved it by delta bytes. Only
+    // kinds, offsets and lengths are compared, so the text both cover must
+    // be outside the edit
+    bool sameToken(size_t index, const TokenBuffer& other, size_t otherIndex, ptrdiff_t delta) const;
+
+    // One past the last token's index, counting the dropped ones
+    size_t size() const { return dropped + kinds.size(); }
+    bool empty() const { return size() == 0; }
+
+    TokenRef operator[](size_t index) const { return TokenRef(this, index); }
+    TokenRef back() const { return TokenRef(this, size() - 1); }
+
+    TokenType type(size_t index) const { return TokenType(kinds[index - dropped]); }
+    uint32_t offset(size_t index) const { return offsets[index - dropped]; }
+    string_view value(size_t index) const;
+    int symbolId(size_t index) const;
+    Keyword keyword(size_t index) const;
+    int indent(size_t index) const;
+    Number number(size_t index) const;
+    int line(size_t index) const { return lineOf(offset(index)); }
+    int column(size_t index) const;
+
+    // Decoded copy of one token. Reader is cheaper for runs of tokens
+    Token token(size_t index) const;
+
+    // Line (1-based) containing a byte offset, and the offset a line starts at
+    int lineOf(size_t offset) const;
+    size_t lineStart(int line) const { return lines()[line - 1]; }
+
+    // Bytes held for the tokens themselves (not the source or line table)
+    size_t memoryUsage() const;
+
+    struct const_iterator {
+        const TokenBuffer* buffer;
+        size_t index;
+        TokenRef operator*() const { return TokenRef(buffer, index); }
+        const_iterator& operator++() { ++index; return *this; }
+        bool operator!=(const const_iterator& other) const { return index != other.index; }
+    };
+    const_iterator begin() const { return { this, dropped }; }
+    const_iterator end() const { return { this, size() }; }
+
+private:
+    static constexpr size_t rankBlock = 64;
+    static constexpr uint32_t storedValue = 1u << 31;  // in lengths: index into storedValues
+    static constexpr size_t minDrop = 64 * rankBlock;  // fewer dropped tokens are kept
+
+    struct Rank { uint32_t identifiers, numbers; };  // before token i * rankBlock
+
+    shared_ptr<const SourceBuffer> source;
+    size_t dropped = 0;  // tokens gone from the front; token i is at i - dropped below
+    vector<uint8_t> kinds;
+    vector<uint32_t> offsets;
+    vector<uint32_t> lengths;
+    vector<int> symbolIds;           // one per identifier, in order
+    vector<Number> numbers;          // one per Number, in order
+    vector<Rank> ranks;              // counts since the first token held
+    vector<string_view> storedValues;  // Error messages that are not source text; never dropped
+
+    mutable vector<uint32_t> lineStarts;  // empty until first needed
+
+    const vector<uint32_t>& lines() const;
+    Token decode(size_t index, int line, int symbolId) const;
+
+    // These take an index into the arrays, not into the token sequence
+    size_t identifiersBefore(size_t index) const { return countBefore(index, TokenType::Identifier, &Rank::identifiers); }
+    size_t numbersBefore(size_t index) const { return countBefore(index, TokenType::Number, &Rank::numbers); }
+    size_t countBefore(size_t index, TokenType kind, uint32_t Rank::*counted) const;
+    void rebuildRanks(size_t fromToken);
+    void pushKind(TokenType type);
+};
+
+// Decodes tokens front to back, tracking the line and identifier count
+// instead of searching for them
+class TokenBuffer::Reader {
+public:
+    // Starts at token from, which must still be held
+    explicit Reader(const TokenBuffer& buffer, size_t from = 0);
+
+    bool atEnd() const { return index == buffer.size(); }
+    Token next();
+
+private:
+    const TokenBuffer& buffer;
+    const vector<uint32_t>& lineStarts;
+    string_view text;
+    size_t index = 0, identifiers = 0, numbers = 0, line = 0;  // the counts index the buffer's arrays
+};
+
+inline TokenType TokenRef::type() const { return buffer->type(index); }
+inline string_view TokenRef::value() const { return buffer->value(index); }
+inline int TokenRef::line() const { return buffer->line(index); }
+inline int TokenRef::column() const { return buffer->column(index); }
+inline int TokenRef::symbolId() const { return buffer->symbolId(index); }
+inline Keyword TokenRef::keyword() const { return buffer->keyword(index); }
+inline int TokenRef::indent() const { return buffer->indent(index); }
+inline Number TokenRef::number() const { return buffer->number(index); }
+inline uint32_t TokenRef::offset() const { return buffer->offset(index); }
+inline Token TokenRef::token() const { return buffer->token(index); }
+
+#endif // TOKENBUFFER_H
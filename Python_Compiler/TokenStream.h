@@ -0,0 +1,89 @@
+#ifndef TOKENSTREAM_H
+#define TOKENSTREAM_H
+
+#include <array>
+#include <memory>
+#include "lexer.h"
+
+using namespace std;
+
+// The parser's cursor over a TokenBuffer. The tokens at and just after the
+// cursor are kept decoded in a small ring buffer, so the parser reads them
+// by reference and nothing is copied as it moves on.
+//
+// Made from a Lexer, the buffer starts empty and tokens are lexed into it
+// only as the cursor reaches them, so lexing and parsing interleave. Made
+// from a TokenBuffer, it replays that, from the start or from a given token.
+// Either way the buffer ends up holding every token read, unless the
+// tokens behind the parser are released, and position() is the cursor's
+// index in it, which is what AST nodes record.
+class TokenStream {
+public:
+    // Tokens that can be looked at from the cursor on (a power of two)
+    static constexpr size_t window = 4;
+
+    explicit TokenStream(shared_ptr<Lexer> lexer)
+        : lexer(move(lexer)), filled(make_shared<TokenBuffer>(this->lexer->getSource())), tokens(filled) {}
+
+    explicit TokenStream(shared_ptr<const TokenBuffer> tokens, uint32_t from = 0)
+        : tokens(tokens), replay(make_shared<TokenBuffer::Reader>(*tokens, from)), cursor(from) {}
+
+    // The token `ahead` positions after the cursor; ahead must be less than
+    // window. Valid until the cursor moves past it
+    const Token& peek(size_t ahead = 0) {
+        while (count <= ahead) {
+            ring[(head + count) % window] = pull();
+            ++count;
+        }
+        return ring[(head + ahead) % window];
+    }
+
+    // Moves the cursor to the next token; it stays on EOF at the end of input
+    void advance() {
+        if (peek().type == TokenType::EOFToken) return;
+        head = (head + 1) % window;
+        --count;
+        ++cursor;
+    }
+
+    // Index of the token at the cursor in buffer()
+    uint32_t position() const { return cursor; }
+
+    // Made from a Lexer, lets the buffer drop the tokens before index (see
+    // TokenBuffer::dropBefore), for a caller that keeps no nodes referring
+    // to them; so memory stays bounded however long the input. Does nothing
+    // to a buffer being replayed, which is shared
+    void release(uint32_t before) {
+        if (filled) filled->dropBefore(before);
+    }
+
+    // The tokens read so far; all of them once the cursor is on EOF, unless
+    // some were released
+    const TokenBuffer& buffer() const { return *tokens; }
+    shared_ptr<const TokenBuffer> share() const { return tokens; }
+
+private:
+    Token pull() {
+        if (ended) return last;
+        if (lexer) {
+            last = lexer->nextToken();
+            filled->append(last);
+        } else if (!replay->atEnd()) {
+            last = replay->next();
+        }
+        ended = last.type == TokenType::EOFToken;
+        return last;
+    }
+
+    shared_ptr<Lexer> lexer;
+    shared_ptr<TokenBuffer> filled;  // lexer only: the buffer tokens are lexed into
+    shared_ptr<const TokenBuffer> tokens;
+    shared_ptr<TokenBuffer::Reader> replay;
+    Token last{ TokenType::EOFToken, "EOF", 0, 0 };  // repeated once the input runs out
+    bool ended = false;
+    array<Token, window> ring{};
+    size_t head = 0, count = 0;
+    uint32_t cursor = 0;
+};
+
+#endif // TOKENSTREAM_H
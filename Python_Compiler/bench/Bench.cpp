@@ -0,0 +1,156 @@
+#include "Bench.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <vector>
+
+namespace {
+
+using bench::Random;
+
+atomic<size_t> allocations{0};
+
+const char* const names[] = { "a", "b", "c", "x", "y", "total", "f", "g", "h", "count" };
+const char* const functions[] = { "f", "g", "h", "calc" };
+const char* const operators[] = { "+", "-", "*", "/", "==", "!=", "<", ">", "<=", ">=", "and", "or" };
+
+class ProgramWriter {
+public:
+    explicit ProgramWriter(uint32_t seed) : random(seed) {}
+
+    void statement(int indent, int depth) {
+        string prefix(size_t(indent) * 4, ' ');
+        switch (random.below(depth < 4 ? 10 : 4)) {
+        case 0: case 1: case 2:
+            line(prefix + random.pick(names) + " = " + expression(0));
+            break;
+        case 3:
+            line(prefix + random.pick(functions) + "(" + expression(0) + ")");
+            break;
+        case 4:
+            line(prefix + (indent > 0 ? "return " : "total = ") + expression(0));
+            break;
+        case 5:
+            line(prefix + "if " + expression(0) + ":");
+            block(indent + 1, depth + 1);
+            while (random.chance(40)) {
+                line(prefix + "elif " + expression(0) + ":");
+                block(indent + 1, depth + 1);
+            }
+            if (random.chance(50)) {
+                line(prefix + "else:");
+                block(indent + 1, depth + 1);
+            }
+            break;
+        case 6:
+            line(prefix + "while " + expression(0) + ":");
+            block(indent + 1, depth + 1);
+            break;
+        case 7:
+            line(prefix + "for " + random.pick(names) + " in " + expression(0) + ":");
+            block(indent + 1, depth + 1);
+            break;
+        default: {
+            string parameters;
+            for (uint32_t i = random.below(4); i > 0; --i) {
+                parameters += string(random.pick(names)) + (i > 1 ? ", " : "");
+            }
+            line(prefix + "def " + random.pick(functions) + "(" + parameters + "):");
+            block(indent + 1, depth + 1);
+            break;
+        }
+        }
+    }
+
+    size_t lines = 0;
+    string text;
+
+private:
+    Random random;
+
+    void line(const string& content) {
+        text += content;
+        text += '\n';
+        ++lines;
+    }
+
+    void block(int indent, int depth) {
+        for (uint32_t i = 1 + random.below(4); i > 0; --i) statement(indent, depth);
+    }
+
+    string expression(int depth) {
+        switch (random.below(depth < 3 ? 10 : 5)) {
+        case 0: return to_string(random.below(101));
+        case 1: return to_string(random.below(51)) + "." + to_string(random.below(10));
+        case 2: return random.chance(34) ? "\"hi\"" : random.chance(50) ? "True" : "False";
+        case 3: case 4: return random.pick(names);
+        case 5: {
+            string call = string(random.pick(functions)) + "(";
+            for (uint32_t i = random.below(3); i > 0; --i) call += expression(depth + 1) + (i > 1 ? ", " : "");
+            return call + ")";
+        }
+        case 6: return (random.chance(50) ? "-" : "not ") + expression(depth + 1);
+        case 7: return "(" + expression(depth + 1) + ")";
+        default: return expression(depth + 1) + " " + random.pick(operators) + " " + expression(depth + 1);
+        }
+    }
+};
+
+const char* const snippets[] = {
+    "x", "a", " ", "\n", "    ", "\n    ", ":", "(", ")", "1", "+", " - ", "=", ",", "2.5", "\"", "#",
+    "\n\n", "        ", "not ", " and ", "f(", "elif ", "return ", "else:\n", "def f(a):\n",
+    "while y:\n", "if x:\n    y = 1\n", "for i in z:\n  ",
+};
+
+} // namespace
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* memory = malloc(size ? size : 1)) return memory;
+    throw bad_alloc();
+}
+
+void operator delete(void* memory) noexcept { free(memory); }
+void operator delete(void* memory, size_t) noexcept { free(memory); }
+
+namespace bench {
+
+size_t allocationCount() { return allocations; }
+
+string generateProgram(size_t lines, uint32_t seed) {
+    ProgramWriter writer(seed);
+    while (writer.lines < lines) writer.statement(0, 0);
+    return move(writer.text);
+}
+
+TextEdit randomEdit(string_view text, Random& random) {
+    TextEdit edit;
+    edit.offset = random.below(uint32_t(text.size() + 1));
+    size_t room = text.size() - edit.offset;
+    switch (random.below(3)) {
+    case 0: edit.length = min<size_t>(room, random.below(6)); break;
+    case 1: edit.text = random.pick(snippets); break;
+    default:
+        edit.length = min<size_t>(room, random.below(3));
+        edit.text = random.pick(snippets);
+        break;
+    }
+    return edit;
+}
+
+string programOrInput(const Options& options, size_t lines) {
+    if (options.input.empty()) return generateProgram(lines);
+    ifstream file(options.input, ios::binary);
+    if (!file) {
+        fprintf(stderr, "cannot read %s\n", options.input.c_str());
+        exit(1);
+    }
+    stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+} // namespace bench
@@ -0,0 +1,94 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include "SourceBuffer.h"
+
+using namespace std;
+
+// Helpers shared by the front-end benchmarks (compy_bench). Every case
+// prints its own lines; timings are the fastest of a few runs, since the
+// slower ones measure the machine rather than the code
+namespace bench {
+
+struct Options {
+    string input;  // a file to use instead of the generated program, if set
+    int runs = 5;
+};
+
+using Clock = chrono::steady_clock;
+
+inline double millisecondsSince(Clock::time_point start) {
+    return chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+// Fastest of runs calls of work, in milliseconds
+template <typename Work>
+double bestOf(int runs, Work work) {
+    double best = 1e300;
+    for (int i = 0; i < runs; ++i) {
+        Clock::time_point start = Clock::now();
+        work();
+        best = min(best, millisecondsSince(start));
+    }
+    return best;
+}
+
+// xorshift32, so the same seed gives the same numbers on every platform
+class Random {
+public:
+    explicit Random(uint32_t seed) : state(seed ? seed : 1) {}
+
+    uint32_t next() {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        return state;
+    }
+
+    // In [0, count)
+    uint32_t below(uint32_t count) { return next() % count; }
+    bool chance(uint32_t percent) { return below(100) < percent; }
+
+    template <size_t N>
+    const char* pick(const char* const (&items)[N]) { return items[below(N)]; }
+
+private:
+    uint32_t state;
+};
+
+// Allocations made through operator new since the program started
+size_t allocationCount();
+
+// A program of about `lines` lines using every statement the parser knows:
+// assignments, calls, if/elif/else, while, for, def and return, with
+// expressions nested a few levels. The same seed gives the same program
+string generateProgram(size_t lines, uint32_t seed = 1);
+
+// Replaces length bytes at offset with text
+struct TextEdit {
+    size_t offset = 0, length = 0;
+    string text;
+
+    void applyTo(string& source) const { source.replace(offset, length, text); }
+};
+
+// An edit of text at a random place: a few bytes deleted, a piece of Python
+// inserted (a name, an operator, a newline, indentation, a quote, a block
+// header), or both. A run of them goes through malformed code as well
+TextEdit randomEdit(string_view text, Random& random);
+
+// options.input if given, or else generateProgram(lines)
+string programOrInput(const Options& options, size_t lines);
+
+inline shared_ptr<SourceBuffer> sourceOf(const string& text) { return make_shared<SourceBuffer>(text); }
+
+inline double megabytes(size_t bytes) { return double(bytes) / (1 << 20); }
+
+} // namespace bench
+
+#endif // BENCH_H
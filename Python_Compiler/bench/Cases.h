@@ -0,0 +1,53 @@
+#ifndef CASES_H
+#define CASES_H
+
+#include "Bench.h"
+
+namespace bench {
+
+struct Case {
+    const char* name;
+    const char* description;
+    void (*run)(const Options&);
+};
+
+// LexerBench.cpp
+void tokenizeAllocations(const Options& options);
+void keywordLookup(const Options& options);
+void characterScans(const Options& options);
+void parallelLexing(const Options& options);
+void interning(const Options& options);
+
+// EditBench.cpp
+void incrementalLexing(const Options& options);
+void incrementalParsing(const Options& options);
+
+// IndexBench.cpp
+void symbolIndex(const Options& options);
+
+// ParserBench.cpp
+void scopedLookups(const Options& options);
+void treeTeardown(const Options& options);
+void expressionParsing(const Options& options);
+void parallelParsing(const Options& options);
+void deepNesting(const Options& options);
+
+inline const Case cases[] = {
+    { "tokenize", "lexing speed and allocations per MB, viewed against owned token text", tokenizeAllocations },
+    { "keywords", "keyword recognition: perfect hash against a linear search", keywordLookup },
+    { "scans", "character run scans and the lexer, per instruction set", characterScans },
+    { "edit-lex", "editing through IncrementalLexer, checked against tokenize()", incrementalLexing },
+    { "lex-parallel", "tokenize() against tokenizeParallel() on 1 to 8 threads", parallelLexing },
+    { "intern", "interning many distinct names, against a string-keyed map", interning },
+    { "scopes", "name resolution in deeply nested scopes", scopedLookups },
+    { "index", "updating and querying a symbol index of 10 to 1000 files", symbolIndex },
+    { "teardown", "freeing a parsed tree: its arena against a delete per node", treeTeardown },
+    { "expressions", "parsing pre-lexed tokens, mostly long expressions", expressionParsing },
+    { "edit-parse", "editing through IncrementalParser, checked against run()", incrementalParsing },
+    { "parse-parallel", "run() against runParallel() on 1 to 8 threads", parallelParsing },
+    { "nesting", "parsing expressions 10^5 and blocks 10^4 levels deep", deepNesting },
+};
+
+} // namespace bench
+
+#endif // CASES_H
@@ -0,0 +1,139 @@
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <vector>
+#include "Cases.h"
+#include "Compilation.h"
+#include "IncrementalLexer.h"
+#include "IncrementalParser.h"
+
+namespace bench {
+
+// program as the body of one function, so every line is indented
+static string functionBody(const string& program) {
+    string text = "def main():\n";
+    for (size_t start = 0; start < program.size();) {
+        size_t end = program.find('\n', start);
+        if (end == string::npos) end = program.size();
+        text += "    ";
+        text.append(program, start, end - start);
+        text += '\n';
+        start = end + 1;
+    }
+    return text;
+}
+
+[[noreturn]] static void mismatch(uint32_t seed, int step, const TextEdit& edit, const string& what) {
+    printf("MISMATCH: program %u, edit %d (%zu bytes at %zu replaced with \"%s\"): %s\n", seed, step, edit.length,
+           edit.offset, edit.text.c_str(), what.c_str());
+    exit(1);
+}
+
+// The first difference between two token lists of the same text, or "" if
+// there is none. Symbols are compared by name, since each table numbers
+// them in the order it saw them
+static string tokenDifference(const TokenBuffer& edited, const SymbolTable& editedSymbols,
+                              const TokenBuffer& fresh, const SymbolTable& freshSymbols) {
+    if (edited.size() != fresh.size()) {
+        return to_string(edited.size()) + " tokens instead of " + to_string(fresh.size());
+    }
+    for (size_t i = 0; i < fresh.size(); ++i) {
+        Token a = edited.token(i), b = fresh.token(i);
+        bool same = a.type == b.type && a.offset == b.offset && a.value == b.value && a.line == b.line &&
+                    a.column == b.column && a.indent == b.indent &&
+                    (a.symbolId < 0 ? b.symbolId < 0 : b.symbolId >= 0 &&
+                     editedSymbols.name(a.symbolId) == freshSymbols.name(b.symbolId));
+        if (!same) return "token " + to_string(i) + " is \"" + string(a.value) + "\", not \"" + string(b.value) + "\"";
+    }
+    return "";
+}
+
+// The tree and the errors, for comparing parses of the same text
+static string parseResult(const ProgramNode* ast, const TokenBuffer& tokens, Span<ParseError> errors) {
+    string result = ast->toString(tokens);
+    for (const ParseError& error : errors) {
+        result += to_string(error.line) + ":" + to_string(error.col) + " " + error.message + "\n";
+    }
+    return result;
+}
+
+// One-character edits at random places of text, through an Editor with
+// replace(); how many tokens each does again (what `count` takes from
+// replace's result), and how long it takes. Typing in a line's indentation
+// can change the blocks of every line after it, so the mean is far above
+// the median
+template <class Editor, class Count>
+static void timeEdits(Editor& editor, const string& text, Count count) {
+    const int edits = 1000;
+    Random random(7);
+    vector<size_t> done;
+    Clock::time_point start = Clock::now();
+    for (int i = 0; i < edits; ++i) done.push_back(count(editor.replace(random.below(uint32_t(text.size())), 0, "x")));
+    double ms = millisecondsSince(start);
+    double mean = double(accumulate(done.begin(), done.end(), size_t(0))) / edits;
+    nth_element(done.begin(), done.begin() + edits / 2, done.end());
+    printf("  %d one-character edits: %zu tokens each (median), %.1f (mean), %.3f ms per edit\n", edits,
+           done[edits / 2], mean, ms / edits);
+}
+
+// Random edits of a few small programs, each followed by check(text),
+// which returns what differs from a full run over the edited text
+template <class Editor, class Check>
+static void checkEdits(const char* against, Check check) {
+    const int programs = 8, edits = 400;
+    for (uint32_t seed = 1; seed <= programs; ++seed) {
+        string text = generateProgram(300, seed);
+        Editor editor(sourceOf(text));
+        Random random(seed);
+        for (int step = 0; step < edits; ++step) {
+            TextEdit edit = randomEdit(text, random);
+            editor.replace(edit.offset, edit.length, edit.text);
+            edit.applyTo(text);
+            string difference = check(editor, text);
+            if (!difference.empty()) mismatch(seed, step, edit, difference);
+        }
+    }
+    printf("  %d random edits of %d programs, each as %s has it\n", programs * edits, programs, against);
+}
+
+// IncrementalLexer: the tokens an edit lexes again, on a program and on the
+// same program as one function body, against tokenize() of the whole text.
+// Then random edits, each checked against tokenize()
+void incrementalLexing(const Options& options) {
+    string program = programOrInput(options, 100000);
+    const pair<const char*, string> inputs[] = { { "program", program }, { "one function", functionBody(program) } };
+    for (const auto& [name, text] : inputs) {
+        double full = bestOf(options.runs, [&] { Lexer(sourceOf(text)).tokenize(); });
+        IncrementalLexer lexer(sourceOf(text));
+        printf("%s, %.1f MB, %zu tokens: tokenize %.1f ms\n", name, megabytes(text.size()), lexer.tokens().size(), full);
+        timeEdits(lexer, text, [](const IncrementalLexer::Edit& edit) { return edit.relexed; });
+    }
+
+    checkEdits<IncrementalLexer>("tokenize()", [](IncrementalLexer& lexer, const string& text) {
+        Lexer full(sourceOf(text));
+        TokenBuffer tokens = full.tokenize();
+        return tokenDifference(lexer.tokens(), *lexer.symbols(), tokens, *full.symbols());
+    });
+}
+
+// IncrementalParser: the tokens an edit parses again, on the same inputs,
+// against run() over the whole text. Then random edits, each checked
+// against run()
+void incrementalParsing(const Options& options) {
+    string program = programOrInput(options, 100000);
+    const pair<const char*, string> inputs[] = { { "program", program }, { "one function", functionBody(program) } };
+    for (const auto& [name, text] : inputs) {
+        double full = bestOf(options.runs, [&] { Compilation::run(sourceOf(text)); });
+        IncrementalParser parser(sourceOf(text));
+        printf("%s, %.1f MB, %zu tokens: run %.1f ms\n", name, megabytes(text.size()), parser.tokens().size(), full);
+        timeEdits(parser, text, [](size_t parsed) { return parsed; });
+    }
+
+    checkEdits<IncrementalParser>("run()", [](IncrementalParser& parser, const string& text) {
+        Compilation full = Compilation::run(sourceOf(text));
+        string edited = parseResult(parser.ast(), parser.tokens(), parser.errors());
+        return edited == parseResult(full.ast(), full.tokens(), full.errors()) ? string() : string("the trees or errors differ");
+    });
+}
+
+} // namespace bench
@@ -0,0 +1,85 @@
+#include <vector>
+#include "Cases.h"
+#include "Compilation.h"
+#include "SymbolIndex.h"
+
+namespace bench {
+
+// An index opened from its own bytes, which it keeps alive
+static shared_ptr<const SymbolIndex> indexOf(string bytes) {
+    auto kept = make_shared<string>(move(bytes));
+    return SymbolIndex::open(*kept, kept);
+}
+
+static shared_ptr<const SymbolIndex> segmentOf(const FileSymbols& file) {
+    SymbolIndexWriter writer;
+    writer.update(file);
+    return indexOf(writer.bytes());
+}
+
+// Symbol index upkeep for directories of 10 to 1000 generated files of 100
+// lines each: updating one file's segment in a SymbolIndexSet, against
+// rewriting a single index of every file, and name lookups in both. Every
+// name's definitions and references are checked to be the same either way
+void symbolIndex(const Options& options) {
+    const size_t lookups = 200000;
+    for (size_t fileCount : { 10, 100, 1000 }) {
+        vector<FileSymbols> files;
+        SymbolIndexWriter everything;
+        SymbolIndexSet segments;
+        for (size_t i = 0; i < fileCount; ++i) {
+            Compilation compilation = Compilation::run(sourceOf(generateProgram(100, uint32_t(i + 1))));
+            files.push_back(FileSymbols::collect("src/file" + to_string(i) + ".py", compilation));
+            everything.update(files.back());
+            segments.put(segmentOf(files.back()));
+        }
+        string wholeBytes = everything.bytes();
+        const size_t indexSize = wholeBytes.size();
+        shared_ptr<const SymbolIndex> whole = indexOf(move(wholeBytes));
+
+        const FileSymbols& edited = files[fileCount / 2];
+        double rewrite = bestOf(options.runs, [&] {
+            SymbolIndexWriter writer(whole);
+            writer.update(edited);
+            writer.bytes();
+        });
+        double segment = bestOf(options.runs, [&] { segments.put(segmentOf(edited)); });
+
+        bool same = true;
+        for (uint32_t name = 0; name < whole->nameCount(); ++name) {
+            string_view text = whole->nameOf(name);
+            size_t definitions = 0, references = 0;
+            for (const SymbolIndex* s : segments.segmentsWith(text)) {
+                definitions += s->definitions(text).size();
+                references += s->references(text).size();
+            }
+            same = same && definitions == whole->definitions(text).size() &&
+                   references == whole->references(text).size();
+        }
+
+        size_t wholeHits = 0, segmentHits = 0;
+        double wholeLookups = bestOf(options.runs, [&] {
+            for (size_t i = 0; i < lookups; ++i) {
+                string_view text = whole->nameOf(uint32_t(i % whole->nameCount()));
+                wholeHits += whole->definitions(text).size() + whole->references(text).size();
+            }
+        });
+        double segmentLookups = bestOf(options.runs, [&] {
+            for (size_t i = 0; i < lookups; ++i) {
+                string_view text = whole->nameOf(uint32_t(i % whole->nameCount()));
+                for (const SymbolIndex* s : segments.segmentsWith(text)) {
+                    segmentHits += s->definitions(text).size() + s->references(text).size();
+                }
+            }
+        });
+
+        printf("%zu files, %.1f MB indexed:\n", fileCount, megabytes(indexSize));
+        printf("  update one file: rewrite the index %8.3f ms, replace its segment %6.3f ms%s\n", rewrite, segment,
+               same ? "" : "  (MISMATCH)");
+        printf("  %zu lookups, %.0f places each: one index %6.1f ns each, segments %8.1f ns each%s\n", lookups,
+               double(wholeHits) / lookups / options.runs, wholeLookups * 1e6 / lookups, segmentLookups * 1e6 / lookups,
+               wholeHits == segmentHits ? "" : "  (MISMATCH)");
+    }
+}
+
+} // namespace bench
@@ -0,0 +1,202 @@
+#include <algorithm>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "CharScan.h"
+#include "Cases.h"
+#include "Interner.h"
+#include "Keywords.h"
+#include "lexer.h"
+
+namespace bench {
+
+// A token as the lexer made them before values viewed the source: each
+// one owns a copy of its text
+struct OwnedToken {
+    TokenType type;
+    string value;
+    int line, column;
+    int symbolId;
+};
+
+// Token values view the source, so lexing allocates for the token and
+// symbol tables only, not per token. Against that, the same tokens with
+// owned values, as the lexer used to return them. Most token texts fit in
+// std::string's inline buffer, so those cost copying more than allocations
+void tokenizeAllocations(const Options& options) {
+    string text = programOrInput(options, 200000);
+    const double mb = megabytes(text.size());
+    auto ownedTokens = [&] {
+        TokenBuffer tokens = Lexer(sourceOf(text)).tokenize();
+        vector<OwnedToken> owned;
+        for (size_t i = 0; i < tokens.size(); ++i) {
+            Token token = tokens.token(i);
+            owned.push_back({ token.type, string(token.value), token.line, token.column, token.symbolId });
+        }
+        return owned;
+    };
+
+    size_t before = allocationCount();
+    size_t tokens = Lexer(sourceOf(text)).tokenize().size();
+    size_t allocations = allocationCount() - before;
+    before = allocationCount();
+    ownedTokens();
+    size_t ownedAllocations = allocationCount() - before;
+
+    double ms = bestOf(options.runs, [&] { Lexer(sourceOf(text)).tokenize(); });
+    double ownedMs = bestOf(options.runs, ownedTokens);
+    printf("%.1f MB, %zu tokens\n", mb, tokens);
+    printf("  viewed values: %7.1f ms (%5.1f ms/MB), %8.0f allocations/MB\n", ms, ms / mb, allocations / mb);
+    printf("  owned values:  %7.1f ms (%5.1f ms/MB), %8.0f allocations/MB\n", ownedMs, ownedMs / mb,
+           ownedAllocations / mb);
+}
+
+// Every word of the program that could be a keyword or an identifier
+static vector<string_view> wordsOf(string_view text) {
+    vector<string_view> words;
+    const char* end = text.data() + text.size();
+    for (const char* p = text.data(); p < end;) {
+        if (!charscan::isIdentStart(*p)) {
+            ++p;
+            continue;
+        }
+        const char* start = p;
+        p = charscan::skipIdentifier(p + 1, end);
+        words.emplace_back(start, size_t(p - start));
+    }
+    return words;
+}
+
+// The perfect-hash lookup against the linear search over keyword strings
+// that the lexer used to do
+void keywordLookup(const Options& options) {
+    string text = programOrInput(options, 200000);
+    vector<string_view> words = wordsOf(text);
+    vector<string> keywordList(keywordNames.begin(), keywordNames.end());
+
+    size_t found = 0;
+    double linear = bestOf(options.runs, [&] {
+        found = 0;
+        for (string_view word : words) found += find(keywordList.begin(), keywordList.end(), word) != keywordList.end();
+    });
+    size_t hashed = 0;
+    double perfect = bestOf(options.runs, [&] {
+        hashed = 0;
+        for (string_view word : words) hashed += lookupKeyword(word) != Keyword::NotKeyword;
+    });
+    printf("%zu words, %zu keywords\n", words.size(), found);
+    printf("  std::find over strings: %.2f ns/word\n", linear * 1e6 / words.size());
+    printf("  lookupKeyword:          %.2f ns/word%s\n", perfect * 1e6 / words.size(),
+           hashed == found ? "" : "  (MISMATCH)");
+}
+
+// Assignments between long names, drawn from `distinct` of them
+static string identifierProgram(size_t lines, size_t distinct) {
+    auto name = [&](size_t i) { return "configuration_value_of_module_" + to_string(i % distinct) + "_entry"; };
+    string text;
+    for (size_t i = 0; i < lines; ++i) {
+        text += name(i * 7919) + " = " + name(i * 104729 + 1) + " + " + name(i) + "\n";
+    }
+    return text;
+}
+
+// Assignments of long string literals
+static string stringProgram(size_t lines) {
+    string text;
+    for (size_t i = 0; i < lines; ++i) {
+        text += "message = \"" + string(40 + i % 200, char('a' + i % 26)) + " " + to_string(i) + "\"\n";
+    }
+    return text;
+}
+
+// What the lexer's run scans do to text: names, numbers, blanks and
+// string bodies are skipped a run at a time, anything else a byte at a time
+static size_t scanRuns(string_view text) {
+    const char* p = text.data();
+    const char* end = p + text.size();
+    size_t runs = 0;
+    while (p < end) {
+        if (charscan::isIdentStart(*p)) p = charscan::skipIdentifier(p + 1, end);
+        else if (charscan::isDigit(*p)) p = charscan::skipDigits(p + 1, end);
+        else if (charscan::isBlank(*p)) p = charscan::skipBlanks(p + 1, end);
+        else if (*p == '"') p = min(end, charscan::findQuoteOrNewline(p + 1, end) + 1);
+        else ++p;
+        ++runs;
+    }
+    return runs;
+}
+
+// The run scans alone, then the whole lexer, with each instruction set the
+// CPU has
+void characterScans(const Options& options) {
+    struct Corpus { const char* name; string text; };
+    const Corpus corpora[] = {
+        { "program", programOrInput(options, 200000) },
+        { "long names", identifierProgram(100000, 1000) },
+        { "long strings", stringProgram(100000) },
+    };
+    const pair<charscan::Isa, const char*> isas[] = {
+        { charscan::Isa::Scalar, "scalar" }, { charscan::Isa::SSE2, "SSE2" }, { charscan::Isa::AVX2, "AVX2" },
+    };
+    charscan::Isa detected = charscan::detectedIsa();
+
+    for (const Corpus& corpus : corpora) {
+        double size = megabytes(corpus.text.size());
+        size_t expected = scanRuns(corpus.text);
+        printf("%s, %.1f MB, %zu runs (MB/s):\n", corpus.name, size, expected);
+        for (auto [isa, name] : isas) {
+            if (isa > detected) continue;
+            charscan::setIsa(isa);
+            size_t runs = 0;
+            double scan = bestOf(options.runs, [&] { runs = scanRuns(corpus.text); });
+            double lex = bestOf(options.runs, [&] { Lexer(sourceOf(corpus.text)).tokenize(); });
+            printf("  %-6s  scans %7.0f  lexer %5.0f%s\n", name, size * 1000 / scan, size * 1000 / lex,
+                   runs == expected ? "" : "  (MISMATCH)");
+        }
+    }
+    charscan::setIsa(detected);
+}
+
+// tokenize() against tokenizeParallel() on growing numbers of threads.
+// Past the core count the extra threads only add overhead
+void parallelLexing(const Options& options) {
+    string text = programOrInput(options, 400000);
+    size_t tokens = 0;
+    double serial = bestOf(options.runs, [&] { tokens = Lexer(sourceOf(text)).tokenize().size(); });
+    printf("%.1f MB, %zu tokens, %u cores\n", megabytes(text.size()), tokens, thread::hardware_concurrency());
+    printf("  tokenize:              %7.1f ms\n", serial);
+    for (unsigned threads : { 1u, 2u, 4u, 8u }) {
+        size_t parallelTokens = 0;
+        double ms = bestOf(options.runs, [&] { parallelTokens = Lexer(sourceOf(text)).tokenizeParallel(threads).size(); });
+        printf("  tokenizeParallel(%u):   %7.1f ms, %.2fx%s\n", threads, ms, serial / ms,
+               parallelTokens == tokens ? "" : "  (MISMATCH)");
+    }
+}
+
+// Interning every name of a program with many distinct ones, against the
+// unordered_map<string, int> the symbol table used before; then lexing it
+void interning(const Options& options) {
+    string text = identifierProgram(300000, 150000);
+    vector<string_view> words = wordsOf(text);
+
+    size_t distinct = 0;
+    double mapped = bestOf(options.runs, [&] {
+        unordered_map<string, int> ids;
+        for (string_view word : words) ids.emplace(string(word), int(ids.size()));
+        distinct = ids.size();
+    });
+    size_t atoms = 0;
+    double interned = bestOf(options.runs, [&] {
+        Interner names;
+        for (string_view word : words) names.intern(word);
+        atoms = names.size();
+    });
+    double lexed = bestOf(options.runs, [&] { Lexer(sourceOf(text)).tokenize(); });
+
+    printf("%.1f MB, %zu names, %zu distinct\n", megabytes(text.size()), words.size(), distinct);
+    printf("  unordered_map<string, int>: %6.1f ms\n", mapped);
+    printf("  Interner:                   %6.1f ms%s\n", interned, atoms == distinct ? "" : "  (MISMATCH)");
+    printf("  tokenize:                   %6.1f ms\n", lexed);
+}
+
+} // namespace bench
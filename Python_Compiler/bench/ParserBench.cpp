@@ -0,0 +1,271 @@
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "Cases.h"
+#include "Compilation.h"
+
+namespace bench {
+
+// Functions nested `depth` deep, `count` times over. Each level declares a
+// name, shadows its parent's and reads names from every level out
+static string nestedFunctions(size_t count, size_t depth) {
+    string text;
+    for (size_t f = 0; f < count; ++f) {
+        for (size_t level = 0; level < depth; ++level) {
+            string indent(level * 4, ' ');
+            text += indent + "def f" + to_string(level) + "(p" + to_string(level) + "):\n";
+            text += indent + "    v" + to_string(level) + " = p" + to_string(level) + " + v" + to_string(level / 2) + "\n";
+            text += indent + "    shared = v0 + v" + to_string(level) + "\n";
+        }
+        text += string(depth * 4, ' ') + "return shared\n";
+    }
+    return text;
+}
+
+// Name resolution in deep scopes: ParserSymbolTable's shadow stacks against
+// the stack of per-scope maps searched innermost first that it replaced.
+// Then lexing and parsing deeply nested functions
+void scopedLookups(const Options& options) {
+    const size_t depth = 50, rounds = 200, lookups = 1000;
+
+    // Tokens for the names n0 .. n49, with the atoms the table expects
+    string names;
+    for (size_t i = 0; i < depth; ++i) names += "n" + to_string(i) + " ";
+    auto lexer = make_shared<Lexer>(sourceOf(names));
+    TokenBuffer tokens = lexer->tokenize();
+    vector<Token> nameTokens;
+    for (size_t i = 0; i < depth; ++i) nameTokens.push_back(tokens.token(i));
+
+    long found = 0;
+    double stacks = bestOf(options.runs, [&] {
+        ParserSymbolTable table(lexer->symbols());
+        for (size_t round = 0; round < rounds; ++round) {
+            for (size_t level = 0; level < depth; ++level) {
+                table.beginScope(ScopeKind::Function);
+                table.declare(nameTokens[level], DataType::Int, SymbolRole::Variable);
+            }
+            for (size_t i = 0; i < lookups; ++i) found += table.lookup(nameTokens[i % 8].symbolId);
+            for (size_t level = 0; level < depth; ++level) table.endScope();
+        }
+    });
+    long mapFound = 0;
+    double maps = bestOf(options.runs, [&] {
+        vector<unordered_map<int, int>> scopes(1);
+        int nextId = 0;
+        for (size_t round = 0; round < rounds; ++round) {
+            for (size_t level = 0; level < depth; ++level) {
+                scopes.emplace_back();
+                scopes.back()[nameTokens[level].symbolId] = nextId++;
+            }
+            for (size_t i = 0; i < lookups; ++i) {
+                int atom = nameTokens[i % 8].symbolId, id = -1;
+                for (auto scope = scopes.rbegin(); scope != scopes.rend(); ++scope) {
+                    auto it = scope->find(atom);
+                    if (it != scope->end()) {
+                        id = it->second;
+                        break;
+                    }
+                }
+                mapFound += id;
+            }
+            scopes.resize(1);
+        }
+    });
+    printf("%zu rounds of %zu nested scopes, %zu lookups of outer names each\n", rounds, depth, lookups);
+    printf("  per-scope maps: %6.1f ms\n", maps);
+    printf("  shadow stacks:  %6.1f ms%s\n", stacks, found == mapFound ? "" : "  (MISMATCH)");
+
+    string program = nestedFunctions(150, depth);
+    size_t errors = 0;
+    double parse = bestOf(options.runs, [&] { errors = Compilation::run(sourceOf(program)).errors().size(); });
+    printf("150 functions nested %zu deep, lex + parse: %.1f ms, %zu errors\n", depth, parse, errors);
+}
+
+// A node as trees had them before the arena: a copy of its token, its
+// children owned through unique_ptrs, and a virtual destructor, so freeing
+// a tree is a delete per node
+struct OwnedNode {
+    Token token{};
+    vector<unique_ptr<OwnedNode>> children;
+
+    virtual ~OwnedNode() = default;
+};
+
+static unique_ptr<OwnedNode> ownedCopy(const ASTNode* node, const TokenBuffer& tokens, size_t& count) {
+    auto copy = make_unique<OwnedNode>();
+    ++count;
+    if (node->token != ASTNode::noToken) copy->token = tokens.token(node->token);
+    for (const ASTNode* child : node->children) {
+        if (child) copy->children.push_back(ownedCopy(child, tokens, count));
+    }
+    return copy;
+}
+
+// Lexing and parsing a program, then freeing its tree. The nodes are in
+// the tree's arena, so freeing it costs a free per chunk, not per node.
+// The same tree built of OwnedNodes is freed node by node, for comparison
+void treeTeardown(const Options& options) {
+    string text = programOrInput(options, 100000);
+    double parse = 1e300, teardown = 1e300, ownedTeardown = 1e300;
+    size_t arenaBytes = 0, nodes = 0;
+    for (int i = 0; i < options.runs; ++i) {
+        Clock::time_point start = Clock::now();
+        Compilation compilation = Compilation::run(sourceOf(text), nullptr, true);
+        parse = min(parse, millisecondsSince(start));
+
+        nodes = 0;
+        unique_ptr<OwnedNode> owned = ownedCopy(compilation.ast(), compilation.tokens(), nodes);
+        start = Clock::now();
+        owned.reset();
+        ownedTeardown = min(ownedTeardown, millisecondsSince(start));
+
+        Ast tree = compilation.takeAst();
+        arenaBytes = tree.arena->memoryUsage();
+        start = Clock::now();
+        tree = Ast();
+        teardown = min(teardown, millisecondsSince(start));
+    }
+    printf("%.1f MB, %zu nodes: lex + parse %.1f ms\n", megabytes(text.size()), nodes, parse);
+    printf("  freeing the arena tree:     %8.3f ms (%.1f MB of arena)\n", teardown, megabytes(arenaBytes));
+    printf("  freeing it as OwnedNodes:   %8.3f ms\n", ownedTeardown);
+}
+
+// Assignments of long expressions using every binary operator level
+static string expressionProgram(size_t lines) {
+    static const char* const operators[] = { "+", "-", "*", "/", "<", ">=", "==", "!=", "and", "or" };
+    string text = "a = 1\nb = 2\n";
+    for (size_t i = 0; i < lines; ++i) {
+        text += "x = a";
+        for (size_t j = 0; j < 24; ++j) {
+            text += string(" ") + operators[(i + j * 7) % 10] + ((i + j) % 5 == 0 ? " (b - 1)" : (j % 2 ? " b" : " 3"));
+        }
+        text += "\n";
+    }
+    return text;
+}
+
+// Parsing alone, from tokens lexed beforehand
+static double parseOnly(const Options& options, const string& text) {
+    auto lexer = make_shared<Lexer>(sourceOf(text));
+    auto tokens = make_shared<const TokenBuffer>(lexer->tokenize());
+    return bestOf(options.runs, [&] {
+        ParserSymbolTable symbols(lexer->symbols());
+        Parser parser(TokenStream(tokens), symbols);
+        parser.parseProgram();
+    });
+}
+
+// Precedence climbing over the operator table, on expression-heavy input
+// and on a general program
+void expressionParsing(const Options& options) {
+    string expressions = expressionProgram(70000);
+    string program = programOrInput(options, 100000);
+    printf("70k lines of long expressions (%.1f MB), parse only: %.1f ms\n", megabytes(expressions.size()),
+           parseOnly(options, expressions));
+    printf("program (%.1f MB), parse only: %.1f ms\n", megabytes(program.size()), parseOnly(options, program));
+}
+
+// Where two compilations of the same text differ: "" if their trees,
+// errors and parser symbol tables are the same
+static string differences(const Compilation& a, const Compilation& b) {
+    string found;
+    auto note = [&](const char* what) { found += found.empty() ? what : string(", ") + what; };
+
+    // The trees, node by node in step
+    bool sameTree = true;
+    vector<pair<const ASTNode*, const ASTNode*>> pending{ { a.ast(), b.ast() } };
+    while (sameTree && !pending.empty()) {
+        auto [x, y] = pending.back();
+        pending.pop_back();
+        if (!x || !y) {
+            sameTree = x == y;
+            continue;
+        }
+        sameTree = x->kind == y->kind && x->token == y->token && x->children.size() == y->children.size();
+        for (size_t i = 0; sameTree && i < x->children.size(); ++i) pending.push_back({ x->children[i], y->children[i] });
+    }
+    if (!sameTree) note("trees");
+
+    Span<ParseError> errorsA = a.errors(), errorsB = b.errors();
+    bool sameErrors = errorsA.size() == errorsB.size();
+    for (size_t i = 0; sameErrors && i < errorsA.size(); ++i) {
+        sameErrors = errorsA[i].line == errorsB[i].line && errorsA[i].col == errorsB[i].col &&
+                     errorsA[i].message == errorsB[i].message;
+    }
+    if (!sameErrors) note("errors");
+
+    const ParserSymbolTable &symbolsA = a.parserSymbols(), &symbolsB = b.parserSymbols();
+    Span<ParserSymbolTableEntry> entriesA = symbolsA.getEntries(), entriesB = symbolsB.getEntries();
+    bool sameSymbols = entriesA.size() == entriesB.size();
+    for (size_t i = 0; sameSymbols && i < entriesA.size(); ++i) {
+        const ParserSymbolTableEntry &x = entriesA[i], &y = entriesB[i];
+        sameSymbols = x.name == y.name && x.line == y.line && x.column == y.column && x.dataType == y.dataType &&
+                      x.role == y.role && x.value.toString() == y.value.toString() &&
+                      symbolsA.scopePath(x.scope) == symbolsB.scopePath(y.scope);
+    }
+    if (!sameSymbols) note("symbol tables");
+    return found;
+}
+
+// Compilation::run against runParallel on growing numbers of threads, each
+// result checked to have run()'s tree, errors and symbol tables. Past the
+// core count the extra threads only add overhead
+void parallelParsing(const Options& options) {
+    string text = programOrInput(options, 300000);
+    double serial = bestOf(options.runs, [&] { Compilation::run(sourceOf(text), nullptr, true); });
+    Compilation expected = Compilation::run(sourceOf(text), nullptr, true);
+    printf("%.1f MB, %zu top-level statements, %u cores\n", megabytes(text.size()), expected.ast()->children.size(),
+           thread::hardware_concurrency());
+    printf("  %-20s %7.1f ms\n", "run(lexFirst):", serial);
+    auto report = [&](const char* name, unsigned threads, size_t pieceTokens) {
+        double ms = bestOf(options.runs, [&] { Compilation::runParallel(sourceOf(text), nullptr, threads, pieceTokens); });
+        string differ = differences(expected, Compilation::runParallel(sourceOf(text), nullptr, threads, pieceTokens));
+        printf("  %-20s %7.1f ms, %.2fx%s\n", name, ms, serial / ms,
+               differ.empty() ? "" : ("  (MISMATCH: " + differ + ")").c_str());
+    };
+    for (unsigned threads : { 1u, 2u, 4u, 8u }) report(("runParallel(" + to_string(threads) + "):").c_str(), threads, 0);
+    report("256-token pieces:", 4, 256);
+}
+
+static string repeated(const char* text, size_t count) {
+    string result;
+    for (size_t i = 0; i < count; ++i) result += text;
+    return result;
+}
+
+// Input nested far deeper than any recursive parser could take: 10^5
+// levels of each kind of expression, and blocks 10^4 deep. Each input
+// past the nesting limit gets one error; expressions still parse whole,
+// and the blocks past the limit are skipped
+void deepNesting(const Options& options) {
+    const size_t depth = 100000, blockDepth = depth / 10;
+    string blocks = "x = 1\n";
+    for (size_t i = 0; i < blockDepth; ++i) blocks += string(i, ' ') + "if x:\n";
+    blocks += string(blockDepth, ' ') + "y = 1\n";
+
+    const pair<const char*, string> inputs[] = {
+        { "- - ... x", "x = 1\ny = " + repeated("- ", depth) + "x\n" },
+        { "not not ... x", "x = 1\ny = " + repeated("not ", depth) + "x\n" },
+        { "((...x...))", "x = 1\ny = " + repeated("(", depth) + "x" + repeated(")", depth) + "\n" },
+        { "f(f(...x...))", "x = 1\ny = " + repeated("f(", depth) + "x" + repeated(")", depth) + "\n" },
+        { "1 + 1 + ...", "y = " + repeated("1 + ", depth) + "1\n" },
+        { "a - (a - (...))", "a = 1\ny = " + repeated("a - (", depth) + "a" + repeated(")", depth) + "\n" },
+        { "blocks 10^4 deep", blocks },
+    };
+    for (const auto& [name, text] : inputs) {
+        double parse = 1e300, teardown = 1e300;
+        size_t errors = 0;
+        for (int i = 0; i < options.runs; ++i) {
+            Clock::time_point start = Clock::now();
+            auto compilation = make_unique<Compilation>(Compilation::run(sourceOf(text)));
+            parse = min(parse, millisecondsSince(start));
+            errors = compilation->errors().size();
+            start = Clock::now();
+            compilation.reset();
+            teardown = min(teardown, millisecondsSince(start));
+        }
+        printf("  %-18s parse %7.1f ms, teardown %5.2f ms, %zu errors\n", name, parse, teardown, errors);
+    }
+}
+
+} // namespace bench
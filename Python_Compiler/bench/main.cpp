@@ -0,0 +1,39 @@
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#include "Bench.h"
+#include "Cases.h"
+
+// compy_bench [--input file.py] [--runs n] [case...]
+// Runs the named cases, or all of them. The cases that lex or parse a
+// whole program use the input file if one is given, and a generated
+// program otherwise
+int main(int argc, char** argv) {
+    bench::Options options;
+    vector<string> chosen;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--input") == 0 && i + 1 < argc) {
+            options.input = argv[++i];
+        } else if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) {
+            options.runs = max(1, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--list") == 0) {
+            for (const bench::Case& c : bench::cases) printf("%-16s %s\n", c.name, c.description);
+            return 0;
+        } else {
+            chosen.push_back(argv[i]);
+        }
+    }
+
+    int ran = 0;
+    for (const bench::Case& c : bench::cases) {
+        if (!chosen.empty() && find(chosen.begin(), chosen.end(), c.name) == chosen.end()) continue;
+        printf("== %s: %s\n", c.name, c.description);
+        c.run(options);
+        ++ran;
+    }
+    if (ran < int(max<size_t>(chosen.size(), 1))) {
+        fprintf(stderr, "unknown case; --list shows them\n");
+        return 1;
+    }
+    return 0;
+}
@@ -1,29 +1,249 @@
 #include "lexer.h"
-#include <regex>
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include "Parallel.h"
 
 Lexer::Lexer(QObject *parent)
-    : QObject{parent}
+    : QObject{parent}, source(make_shared<SourceBuffer>(string())), input(source->text())
 {}
 
-vector<Token> Lexer::tokenize() {
-    vector<Token> tokens;
+TokenBuffer Lexer::tokenize() {
+    TokenBuffer tokens(source);
+    Token token;
+    do {
+        token = nextToken();
+        tokens.append(token);
+    } while (token.type != TokenType::EOFToken);
+    return tokens;
+}
+
+// Line starts roughly every `spacing` bytes where the lexer is outside any
+// string, comment and block, so a fresh lexer can take over from there.
+// Strings and comments are skipped by the lexer's own rules (see getString,
+// skipComment); in the plain code between them, a point is any newline
+// followed by a token in the first column, which closes every open block
+static vector<size_t> findSplitPoints(string_view text, size_t spacing) {
+    vector<size_t> starts{0};
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+
+    // The lexer stops at a NUL byte between tokens; never split past one
+    if (const void* nul = memchr(begin, '\0', text.size())) end = static_cast<const char*>(nul);
+
+    auto find = [&](const char* from, char c) {
+        const void* hit = memchr(from, c, size_t(end - from));
+        return hit ? static_cast<const char*>(hit) : end;
+    };
+
+    const char* p = begin;
+    const char* target = begin + min(spacing, text.size());
+    const char* quote = find(p, '"');
+    const char* hash = find(p, '#');
+    while (p < end) {
+        if (quote < p) quote = find(p, '"');
+        if (hash < p) hash = find(p, '#');
+        const char* special = min(quote, hash);
+
+        // Cut at the first such line at or after each target before `special`
+        while (max(target, p) < special) {
+            const char* newline = charscan::findNewline(max(target, p), special);
+            if (newline == special || newline + 1 >= end) break;
+            char first = newline[1];
+            if (charscan::isBlank(first) || first == '\n' || first == '#') {
+                target = newline + 1;  // indented, blank or comment: try the next line
+                continue;
+            }
+            starts.push_back(size_t(newline + 1 - begin));
+            target = newline + 1 + min(spacing, size_t(end - newline - 1));
+        }
+        if (special == end) break;
+
+        if (*special == '#') {
+            p = charscan::findNewline(special, end);  // the newline is code again
+        } else if (end - special >= 3 && special[1] == '"' && special[2] == '"') {
+            // Triple-quoted: jump from quote to quote until three appear in a row
+            const char* scan = special + 3;
+            p = end;
+            for (const char* q = find(scan, '"'); q < end; q = find(q + 1, '"')) {
+                if (end - q >= 3 && q[1] == '"' && q[2] == '"') {
+                    p = q + 3;
+                    break;
+                }
+            }
+        } else if (end - special >= 2 && special[1] == '"') {
+            p = special + 2;  // ""
+        } else {
+            const char* stop = charscan::findQuoteOrNewline(special + 1, end);
+            p = (stop < end && *stop == '"') ? stop + 1 : stop;
+        }
+    }
+    return starts;
+}
+
+TokenBuffer Lexer::tokenizeParallel(unsigned threads, size_t chunkBytes) {
+    if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+    // A few pieces per thread even out lines of very different density
+    if (chunkBytes == 0) chunkBytes = max<size_t>(256 * 1024, input.size() / (size_t(threads) * 4));
+
+    if (threads < 2 || pos != 0 || finished) return tokenize();
+    vector<size_t> starts = findSplitPoints(input, chunkBytes);
+    if (starts.size() < 2) return tokenize();
+
+    const size_t chunks = starts.size();
+    starts.push_back(input.size());
+
+    // Each piece gets its own lexer and symbol table. Token positions are
+    // offsets into the shared source, so they need no fixing up afterwards.
+    // Lexers are made here so they live on this thread
+    vector<unique_ptr<Lexer>> lexers;
+    for (size_t i = 0; i < chunks; ++i) {
+        lexers.push_back(make_unique<Lexer>(source));
+        lexers[i]->deferCalls = true;
+    }
+    vector<TokenBuffer> pieces(chunks);
+    runParallel(chunks, threads, [&](size_t i) {
+        bool last = i + 1 == chunks;
+        lexers[i]->seek(starts[i], 1, last ? input.size() : starts[i + 1]);
+        pieces[i] = lexers[i]->tokenize();
+        // A cut piece ends with Dedents for the blocks still open and EOF.
+        // Those Dedents sit at the next piece's first token, exactly where
+        // the serial lexer closes the blocks, so only the EOF goes
+        if (!last) pieces[i].truncate(pieces[i].size() - 1);
+    });
+
+    // Piece-local IDs are in order of first occurrence within the piece, so
+    // inserting the pieces in order reproduces the serial (file-wide) IDs.
+    // Types follow the same rule as serial: first assignment wins, then calls
+    vector<vector<int>> ids(chunks);
+    size_t localSymbols = 0, total = 0;
+    for (size_t i = 0; i < chunks; ++i) {
+        localSymbols += lexers[i]->symbolTable->getSymbolTable().size();
+        total += pieces[i].size();
+    }
+    symbolTable->reserve(symbolTable->getSymbolTable().size() + localSymbols);
+    for (size_t i = 0; i < chunks; ++i) {
+        const auto& entries = lexers[i]->symbolTable->getSymbolTable();
+        ids[i].reserve(entries.size());
+        for (const auto& entry : entries) {
+            int id = symbolTable->insert(entry.name, lexers[i]->symbolTable->hashOf(entry.id));
+            if (entry.dataType != "unknown") symbolTable->updateType(id, entry.dataType, entry.value);
+            ids[i].push_back(id);
+        }
+    }
+    for (size_t i = 0; i < chunks; ++i) {
+        const vector<bool>& called = lexers[i]->calledIds;
+        for (size_t id = 0; id < called.size(); ++id) {
+            if (called[id]) symbolTable->updateType(ids[i][id], "function");
+        }
+    }
 
-    newLine = true;  // Track start of a new line
+    // At 9 bytes a token, joining is a few block copies plus the ID remap
+    TokenBuffer tokens(source);
+    tokens.reserve(total);
+    for (size_t i = 0; i < chunks; ++i) tokens.append(pieces[i], ids[i]);
 
+    pos = input.size();
+    eofToken = tokens.token(tokens.size() - 1);
+    line = eofToken.line;
+    column = eofToken.column;
+    finished = true;
+    return tokens;
+}
+
+Token Lexer::nextToken() {
+    if (finished) return eofToken;
+
+    Token token = lexToken();
+    token.offset = uint32_t(tokenStart);
+    noteTypes(token);
+    if (token.type == TokenType::EOFToken) {
+        finished = true;
+        eofToken = token;
+    }
+    return token;
+}
+
+void Lexer::seek(size_t offset, int atLine, size_t end) {
+    input = source->text().substr(0, end);
+    pos = offset;
+    line = atLine;
+    column = 1;
+    newLine = true;
+    finished = false;
+    indents.assign(1, 0);
+    pendingDedents = 0;
+    indentMismatch = false;
+    lineHasTokens = false;
+    recent = {};
+}
+
+void Lexer::resume(size_t offset, int atLine, int atColumn, vector<int> openBlocks) {
+    seek(offset, atLine);
+    column = atColumn;
+    newLine = false;
+    indents = move(openBlocks);
+}
+
+void Lexer::retype(const TokenBuffer& tokens) {
+    symbolTable->resetTypes();
+    recent = {};
+    calledIds.clear();
+    for (TokenBuffer::Reader reader(tokens); !reader.atEnd();) noteTypes(reader.next());
+}
+
+Token Lexer::layoutToken(TokenType type, int width) {
+    tokenStart = pos;
+    Token token{ type, input.substr(pos, 0), line, column };
+    token.indent = width;
+    return token;
+}
+
+Token Lexer::lexToken() {
     while (true) {
 
-        //for handling indentations
+        // Dedents owed for the current line come out one per call
+        if (pendingDedents > 0) {
+            --pendingDedents;
+            return layoutToken(TokenType::Dedent, indents.back());
+        }
+        if (indentMismatch) {
+            indentMismatch = false;
+            tokenStart = pos;
+            return { TokenType::Error, "Unindent does not match any outer indentation level", line, column };
+        }
+
+        //for handling indentations. Blank and comment-only lines produce no
+        //tokens at all, so they never open or close a block
         if (newLine) {
-            int currentIndent = getIndentLevel();
+            int width = getIndentLevel();
             while (peek() == ' ' || peek() == '\t') advance();
-
-            // Emit one Indent token per new line, with the indent level in "tabs" (assuming 4 spaces/tab)
-            if (currentIndent >= 0) {
-                int indentLevel = currentIndent / 4;
-                tokens.push_back({ TokenType::Indent, to_string(indentLevel), line, column });
+            skipWhitespace();
+            skipComment();
+            if (peek() == '\n') {
+                advance();
+                continue;
             }
-
             newLine = false;
+
+            if (peek() != '\0') {
+                if (width > indents.back()) {
+                    indents.push_back(width);
+                    return layoutToken(TokenType::Indent, width);
+                }
+                if (width < indents.back()) {
+                    while (indents.back() > width) {
+                        indents.pop_back();
+                        ++pendingDedents;
+                    }
+                    // Recover as if the line opened a block of its own width
+                    if (indents.back() != width) {
+                        indentMismatch = true;
+                        indents.push_back(width);
+                    }
+                    continue;
+                }
+            }
         }
 
         skipWhitespace();
@@ -31,41 +251,61 @@ vector<Token> Lexer::tokenize() {
 
         char c = peek();
         int startCol = column;
+        tokenStart = pos;
 
         if (c == '\0') {
-            tokens.push_back({ TokenType::EOFToken, "EOF", line, column });
-            break;
-        } else if (isalpha(c) || c == '_') {
-            tokens.push_back(getIdentifier());
-        } else if (isdigit(c)) {
-            tokens.push_back(getNumber());
+            // Close the last line and every open block before EOF
+            if (lineHasTokens) {
+                lineHasTokens = false;
+                return { TokenType::Newline, input.substr(pos, 0), line, column };
+            }
+            if (indents.size() > 1) {
+                indents.pop_back();
+                return layoutToken(TokenType::Dedent, 0);  // the end counts as an unindented line
+            }
+            return { TokenType::EOFToken, "EOF", line, column };
+        } else if (c == '\n') {
+            Token token{ TokenType::Newline, input.substr(pos, 1), line, startCol };
+            advance(); // sets newLine
+            if (lineHasTokens) {
+                lineHasTokens = false;
+                return token;
+            }
+            continue;
+        }
+
+        lineHasTokens = true;
+        if (charscan::isIdentStart(c)) {
+            return getIdentifier();
+        } else if (charscan::isDigit(c)) {
+            return getNumber();
         } else if (c == '"') {
-            tokens.push_back(getString());
+            return getString();
         } else if (c == '+' || c == '-' || c == '*' || c == '/' || c == '=' ||
                    c == '<' || c == '>' || c == '!' || c == '.') {
-            tokens.push_back(getOperator());
+            return getOperator();
         } else if (c == '(' || c == ')' || c == ':' || c == ',') {
-            tokens.push_back({ TokenType::Delimiter, std::string(1, advance()), line, startCol });
-        } else if (c == '\n') {
-            advance(); // skip newline
-            newLine = true;
+            Token token{ TokenType::Delimiter, input.substr(pos, 1), line, startCol };
+            advance();
+            return token;
         } else {
             // Unrecognized character
-            tokens.push_back({ TokenType::Error, std::string(1, advance()), line, startCol });
+            Token token{ TokenType::Error, input.substr(pos, 1), line, startCol };
+            advance();
+            return token;
         }
     }
-
-    detectTypes();
-    return tokens;
 }
 
-void Lexer::printTokens(const vector<Token> &tokens) {
+void Lexer::printTokens(const TokenBuffer &tokens) {
     cout << "Tokens:\n";
     int count = 1;
-    for (const auto& token : tokens) {
+    for (TokenBuffer::Reader reader(tokens); !reader.atEnd();) {
+        Token token = reader.next();
         if (token.type == TokenType::EOFToken) break;
         if (token.type == TokenType::Error) continue;  //Skip error tokens
-        if (token.type == TokenType::Indent) continue;  //Skip indent tokens
+        if (token.type == TokenType::Indent || token.type == TokenType::Dedent ||
+            token.type == TokenType::Newline) continue;  //Skip layout tokens
 
         cout << count++ << ". <";
 
@@ -89,7 +329,7 @@ void Lexer::printTokens(const vector<Token> &tokens) {
             cout << token.value;
             break;
         case TokenType::Indent:
-            cout << "Indent, "<<token.value;
+            cout << "Indent, "<<token.indent;
             break;
         default:
             cout << "unknown";
@@ -100,25 +340,20 @@ void Lexer::printTokens(const vector<Token> &tokens) {
 }
 
 void Lexer::printSymbolTable() {
-    symbolTable.print();
+    symbolTable->print();
 }
 
-void Lexer::printErrors(const vector<Token> &tokens) {
+void Lexer::printErrors(const TokenBuffer &tokens) {
     cout << "\nLexical Errors:\n";
     int count = 1;
-    for (const auto& token : tokens) {
-        if (token.type == TokenType::Error) {
-            cout << count++ << ". Invalid token: \"" << token.value
-                 << "\" at line " << token.line << ", column " << token.column << '\n';
+    for (TokenRef token : tokens) {
+        if (token.type() == TokenType::Error) {
+            cout << count++ << ". Invalid token: \"" << token.value()
+                 << "\" at line " << token.line() << ", column " << token.column() << '\n';
         }
     }
 }
 
-std::vector<SymbolTableEntry> Lexer::getSymbolTable()
-{
-    return symbolTable.getSymbolTable();
-}
-
 char Lexer::peek(int offset) const {
     if (pos + offset < input.size()) {
         return input[pos + offset];  // Look ahead by offset
@@ -143,102 +378,137 @@ char Lexer::advance() {
     return c;
 }
 
-bool Lexer::isKeyword(const string &word) {
-    return find(keywords.begin(), keywords.end(), word) != keywords.end();
+void Lexer::advanceInLine(size_t count) {
+    pos += count;
+    column += int(count);
+    if (count > 0) newLine = false;
+}
+
+void Lexer::advanceAcross(size_t count) {
+    string_view span = input.substr(pos, count);
+    size_t lastNewline = span.rfind('\n');
+    if (lastNewline == string_view::npos) {
+        advanceInLine(count);
+        return;
+    }
+
+    line += int(std::count(span.begin(), span.end(), '\n'));
+    column = int(count - lastNewline);
+    pos += count;
+
+    // As with advance(), newLine survives only while the current line is still indentation
+    string_view tail = span.substr(lastNewline + 1);
+    newLine = all_of(tail.begin(), tail.end(), [](char c) { return c == ' ' || c == '\t'; });
 }
 
 void Lexer::skipWhitespace() {
-    while (isspace(peek()) && peek() != '\n') advance();
+    advanceInLine(charscan::skipBlanks(cursor(), inputEnd()) - cursor());
 }
 
 void Lexer::skipComment() {
     if (peek() == '#') {
-        while (peek() != '\n' && peek() != '\0') advance();
+        advanceInLine(charscan::findNewline(cursor(), inputEnd()) - cursor());
     }
 }
 
 Token Lexer::getIdentifier() {
     int startCol = column;
-    string value;
-    while (isalnum(peek()) || peek() == '_') {
-        value += advance();
-    }
+    size_t start = pos;
+
+    advanceInLine(charscan::skipIdentifier(cursor(), inputEnd()) - cursor());
+    string_view value = input.substr(start, pos - start);
 
-    if (isKeyword(value)) {
-        return { TokenType::Keyword, value, line, startCol };
+    Keyword keyword = lookupKeyword(value);
+    if (keyword != Keyword::NotKeyword) {
+        return { TokenType::Keyword, value, line, startCol, -1, keyword };
     } else {
-        int id = symbolTable.insert(value);
+        int id = symbolTable->insert(value);
         return { TokenType::Identifier, value, line, startCol, id };
     }
 }
 
 Token Lexer::getNumber() {
     int startCol = column;
-    string value;
+    size_t start = pos;
 
     // Handle leading zero formats
     if (peek() == '0') {
-        value += advance();
+        advance();
         char next = tolower(peek());
 
         //handle hexa- octal- binary numbers
         if (next == 'x' || next == 'o' || next == 'b') {
-            value += advance(); // consume x, o, or b
+            advance(); // consume x, o, or b
             int base = (next == 'x') ? 16 : (next == 'o') ? 8 : 2;
 
             bool hasValidDigit = false;
 
-            while (isalnum(peek())) {
+            while (charscan::isAlnum(peek())) {
                 char c = peek();
 
                 // Validate digit based on base
                 if ((base == 2 && (c != '0' && c != '1')) ||
                     (base == 8 && (c < '0' || c > '7')) ||
-                    (base == 16 && !isxdigit(c))) {
-                    return { TokenType::Error, "Invalid digit for base " + to_string(base) + ": " + value + c, line, startCol };
+                    (base == 16 && !charscan::isHexDigit(c))) {
+                    return { TokenType::Error,
+                             source->store("Invalid digit for base " + to_string(base) + ": " +
+                                           string(input.substr(start, pos - start)) + c),
+                             line, startCol };
                 }
 
-                value += advance();
+                advance();
                 hasValidDigit = true;
             }
 
             if (!hasValidDigit) {
-                return { TokenType::Error, "Expected digits after prefix: " + value, line, startCol };
+                return { TokenType::Error,
+                         source->store("Expected digits after prefix: " + string(input.substr(start, pos - start))),
+                         line, startCol };
             }
 
-            return { TokenType::Number, value, line, startCol };
+            return numberToken(start, start + 2, base, false, startCol);
         }
 
         // If not one of the special bases, check for leading zero error ex: 023
-        if (isdigit(peek())) {
-            while (isdigit(peek())) value += advance();
-            return { TokenType::Error, "Invalid number with leading zero: " + value, line, startCol };
+        if (charscan::isDigit(peek())) {
+            skipDigits();
+            return { TokenType::Error,
+                     source->store("Invalid number with leading zero: " + string(input.substr(start, pos - start))),
+                     line, startCol };
         }
     }
 
     // Decimal number
-    while (isdigit(peek())) value += advance();
+    skipDigits();
 
     // Handle float
-    if (peek() == '.') {
-        value += advance();
-        while (isdigit(peek())) value += advance();
+    bool isFloat = peek() == '.';
+    if (isFloat) {
+        advance();
+        skipDigits();
     }
 
     // Check for invalid trailing characters (e.g., 123abc)
-    if (isalpha(peek()) || peek() == '_') {
-        while (isalnum(peek()) || peek() == '_') {
-            value += advance();
-        }
-        return { TokenType::Error, value, line, startCol };
+    if (charscan::isIdentStart(peek())) {
+        advanceInLine(charscan::skipIdentifier(cursor(), inputEnd()) - cursor());
+        return { TokenType::Error, input.substr(start, pos - start), line, startCol };
     }
 
-    return { TokenType::Number, value, line, startCol };
+    return numberToken(start, start, 10, isFloat, startCol);
+}
+
+Token Lexer::numberToken(size_t start, size_t digitsStart, int base, bool isFloat, int startCol) {
+    Token token{ TokenType::Number, input.substr(start, pos - start), line, startCol };
+    string_view digits = input.substr(digitsStart, pos - digitsStart);
+    if (!decodeNumber(digits, base, isFloat, token.number)) {
+        token.number.kind = Number::Kind::BigInt;
+        token.number.big = source->store(BigInt::parse(digits, base));
+    }
+    return token;
 }
 
 Token Lexer::getString() {
-    int startCol = column;
-    string value;
+    int startLine = line, startCol = column;
 
     // Check if it's """ or "
     advance(); // skip first "
@@ -251,49 +521,54 @@ Token Lexer::getString() {
             isTriple = true;
         } else {
             // It was just "", treat as empty string
-            return { TokenType::String, "", line, startCol };
+            return { TokenType::String, "", startLine, startCol };
         }
     }
 
-    while (true) {
-        if (peek() == '\0') {
-            // EOF reached before closing quotes
-            return { TokenType::Error, "Unterminated string", line, startCol };
-        }
+    // The value is the text between the quotes, which is always a contiguous slice of the input
+    size_t start = pos;
 
-        if (!isTriple && peek() == '\n') {
-            // Newline in a single-quote string is an error
-            return { TokenType::Error, "Unterminated string", line, startCol };
+    if (!isTriple) {
+        // Scan straight to the closing quote; a newline in a single-quote string is an error
+        const char* stop = charscan::findQuoteOrNewline(cursor(), inputEnd());
+        advanceInLine(stop - cursor());
+        if (stop == inputEnd() || *stop == '\n') {
+            return { TokenType::Error, "Unterminated string", startLine, startCol };
         }
+        string_view value = input.substr(start, pos - start);
+        advanceInLine(1); // Skip closing "
+        return { TokenType::String, value, startLine, startCol };
+    }
 
-        if (isTriple) {
-            if (peek() == '"' && peek(1) == '"' && peek(2) == '"') {
-                advance(); advance(); advance(); // Skip closing """
-                break;
-            }
-        } else {
-            if (peek() == '"') {
-                advance(); // Skip closing "
-                break;
-            }
+    // Triple-quoted: jump from quote to quote until three appear in a row
+    const char* scan = cursor();
+    while (true) {
+        const char* quote = charscan::findQuote(scan, inputEnd());
+        if (quote == inputEnd()) {
+            // EOF reached before closing quotes
+            advanceAcross(quote - cursor());
+            return { TokenType::Error, "Unterminated string", startLine, startCol };
         }
-
-        value += advance();
+        if (inputEnd() - quote >= 3 && quote[1] == '"' && quote[2] == '"') {
+            advanceAcross(quote - cursor());
+            string_view value = input.substr(start, pos - start);
+            advanceInLine(3); // Skip closing """
+            return { TokenType::String, value, startLine, startCol };
+        }
+        scan = quote + 1;
     }
-
-    return { TokenType::String, value, line, startCol };
 }
 
 Token Lexer::getOperator() {
     int startCol = column;
-    string value;
+    size_t start = pos;
     char c = advance();
-    value += c;
 
     // Handle compound operators like ==, !=, <=, >=
     if ((c == '=' || c == '!' || c == '<' || c == '>') && peek() == '=') {
-        value += advance();
+        advance();
     }
+    string_view value = input.substr(start, pos - start);
 
     // Handle '.' as a standalone operator (exclude float cases later in detectNumber)
     if (c == '.') {
@@ -306,65 +581,52 @@ Token Lexer::getOperator() {
 }
 
 int Lexer::getIndentLevel() {
-    int level = 0;
-    size_t tempPos = pos;
+    return indentWidth(input, pos);
+}
 
-    while (input[tempPos] == ' ' || input[tempPos] == '\t') {
-        if (input[tempPos] == ' ') level += 1;
-        else if (input[tempPos] == '\t') level += 4; // 1 tab = 4 spaces (Python standard)
-        tempPos++;
+int Lexer::indentWidth(string_view text, size_t offset) {
+    int level = 0;
+    for (; offset < text.size() && (text[offset] == ' ' || text[offset] == '\t'); ++offset) {
+        level += text[offset] == ' ' ? 1 : 4;  // 1 tab = 4 spaces (Python standard)
     }
-
     return level;
 }
 
-void Lexer::detectTypes() {
-    regex assignRegex(R"(([a-zA-Z_][a-zA-Z0-9_]*)\s*=\s*([^\n#]+))");
-    regex funcRegex(R"(\bdef\s+([a-zA-Z_][a-zA-Z0-9_]*)\s*\()");
-    smatch match;
+void Lexer::noteTypes(const Token& token) {
+    const Token& name = recent[0];
+    const Token& op = recent[1];
+    const Token& last = recent[2];
 
-    string::const_iterator searchStart(input.cbegin());
-
-    // First: detect variable assignments
-    while (regex_search(searchStart, input.cend(), match, assignRegex)) {
-        string var = match[1];
-        string expr = match[2];
-
-        string type = "unknown";
-        string cleanedExpr = regex_replace(expr, regex(R"(\s+)"), "");  // Remove spaces
+    // name( -> function definition or call. Applied once the input is
+    // exhausted, because assignments take precedence
+    if (last.type == TokenType::Identifier && token.type == TokenType::Delimiter && token.value == "(") {
+        if (last.symbolId >= int(calledIds.size())) calledIds.resize(last.symbolId + 1);
+        calledIds[last.symbolId] = true;
+    }
 
-        // Check if the expression is a literal value
-        if (regex_match(cleanedExpr, regex(R"([0-9]+)"))) {  // Integer
-            type = "int";
-            symbolTable.updateType(var, type, cleanedExpr);
-        }
-        else if (regex_match(cleanedExpr, regex(R"([0-9]+\.[0-9]+)"))) {  // Float
-            type = "float";
-            symbolTable.updateType(var, type, cleanedExpr);
-        }
-        else if (regex_match(cleanedExpr, regex(R"(\".*\"|\'.*\')"))) {  // String
-            type = "string";
-            symbolTable.updateType(var, type, cleanedExpr);
-        }
-        else if (regex_match(cleanedExpr, regex(R"(True|False)"))) {  // Boolean
-            type = "bool";
-            symbolTable.updateType(var, type, cleanedExpr);
+    // name = literal, where the literal is the only token left on the line.
+    // Anything longer is an expression whose type stays unknown
+    if (token.type == TokenType::Newline &&
+        name.type == TokenType::Identifier && op.type == TokenType::Operator && op.value == "=") {
+        const Token& literal = last;
+        if (literal.type == TokenType::Number) {
+            symbolTable->updateType(name.symbolId, literal.number.isInteger() ? "int" : "float", string(literal.value));
+        } else if (literal.type == TokenType::String) {
+            symbolTable->updateType(name.symbolId, "string", "\"" + string(literal.value) + "\"");
+        } else if (literal.type == TokenType::Keyword &&
+                   (literal.keyword == Keyword::True || literal.keyword == Keyword::False)) {  // Boolean
+            symbolTable->updateType(name.symbolId, "bool", string(literal.value));
         }
-        else {
-            // The value is a complex expression or function call -> value remains unknown
-            symbolTable.updateType(var, type);  // Just update the type to "unknown"
-        }
-
-        searchStart = match.suffix().first;
     }
 
-    // Second: detect function declarations
-    regex callRegex(R"(\b([a-zA-Z_][a-zA-Z0-9_]*)\s*\()");
-    searchStart = input.cbegin();
-    while (regex_search(searchStart, input.cend(), match, callRegex)) {
-        string funcName = match[1];
-        symbolTable.updateType(funcName, "function");
-        searchStart = match.suffix().first;
+    recent[0] = recent[1];
+    recent[1] = recent[2];
+    recent[2] = token;
+
+    if (token.type == TokenType::EOFToken && !deferCalls) {
+        for (size_t id = 0; id < calledIds.size(); ++id) {
+            if (calledIds[id]) symbolTable->updateType(int(id), "function");
+        }
+        calledIds.clear();
     }
 }
-
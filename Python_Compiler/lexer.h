@@ -2,7 +2,12 @@
 #define LEXER_H
 
 #include <QObject>
+#include <array>
 #include "AST_Node.h"
+#include "SourceBuffer.h"
+#include "TokenBuffer.h"
+#include "CharScan.h"
+#include "Span.h"
 #include <SymbolTable.h>
 
 using namespace std;
@@ -15,38 +20,81 @@ public:
 
 public:
     // Constructor
-    Lexer(const std::string& input) : input(input) {}
+    Lexer(const std::string& input)
+        : source(make_shared<SourceBuffer>(input)), input(source->text()) {}
+
+    // Lexes an existing buffer in place, e.g. a memory-mapped file or a
+    // caller-owned string wrapped with SourceBuffer::borrow(); nothing is copied
+    explicit Lexer(shared_ptr<SourceBuffer> buffer)
+        : source(move(buffer)), input(source->text()) {}
+
+    // Same, adding to an existing symbol table (names it has keep their IDs),
+    // e.g. to parse a buffer another lexer has already shown
+    Lexer(shared_ptr<SourceBuffer> buffer, shared_ptr<SymbolTable> symbols)
+        : source(move(buffer)), input(source->text()), symbolTable(move(symbols)) {}
 
     // Tokenizes the entire input and returns all tokens
-    vector<Token> tokenize();
+    TokenBuffer tokenize();
+
+    // Same result as tokenize(), but the input is cut at unindented line
+    // starts outside strings and comments and the pieces are lexed on
+    // `threads` threads (0: one per core). Inputs too small to split are
+    // lexed serially. chunkBytes overrides the target piece size
+    TokenBuffer tokenizeParallel(unsigned threads = 0, size_t chunkBytes = 0);
+
+    // Lexes and returns just the next token, so a consumer can pull tokens as
+    // it goes instead of holding them all. Keeps returning the EOF token once
+    // the input is exhausted. Symbol types are complete once EOF has been returned
+    Token nextToken();
 
     // Prints tokens in the required format
-    void printTokens(const vector<Token>& tokens);
+    void printTokens(const TokenBuffer& tokens);
 
 
     // Prints the symbol table contents
     void printSymbolTable();
 
-    void printErrors(const vector<Token>& tokens);
+    void printErrors(const TokenBuffer& tokens);
+
+
+    // Valid until the next token is lexed
+    Span<SymbolTableEntry> getSymbolTable() const { return symbolTable->getSymbolTable(); }
 
+    // The table this lexer's symbol IDs index; a parser of its tokens
+    // declares names by these IDs (see ParserSymbolTable)
+    shared_ptr<SymbolTable> symbols() const { return symbolTable; }
 
-    std::vector<SymbolTableEntry> getSymbolTable();
+    // Used by IncrementalLexer to re-lex part of an edited buffer: continue
+    // from a line start outside any token and outside any block (nothing
+    // indented is open), keeping the symbol table (and so every symbol ID).
+    // Also picks up the buffer's current text
+    void seek(size_t offset, int atLine, size_t end = string_view::npos);
+
+    // The same, but from the first token of a line whose indentation has
+    // been dealt with: openBlocks are the widths of the blocks open there,
+    // outermost (0) first, the line's own last. No Dedents are owed at that
+    // point, so nothing else carries over from the lines before
+    void resume(size_t offset, int atLine, int atColumn, vector<int> openBlocks);
+
+    // Width of the indentation starting at offset; a tab counts as 4 spaces
+    static int indentWidth(string_view text, size_t offset);
+
+    // Recomputes symbol types from a complete token list (ending in EOF)
+    void retype(const TokenBuffer& tokens);
+
+    // The buffer every token value points into; keep it for as long as the tokens
+    shared_ptr<const SourceBuffer> getSource() const { return source; }
 
 private:
-    string input;
+    shared_ptr<SourceBuffer> source;
+    string_view input;
     size_t pos = 0; // points to the current character you're looking at in the input string.
+    size_t tokenStart = 0;  // where the token being lexed begins
     int line = 1, column = 1;
-    SymbolTable symbolTable;
-    bool newLine;
-    // List of all Python keywords
-    vector<string> keywords = {
-        "False", "None", "True", "and", "as", "assert",
-        "async", "await", "break", "class", "continue",
-        "def", "del", "elif", "else", "except", "finally",
-        "for", "from", "global", "if", "import", "in",
-        "is", "lambda", "nonlocal", "not", "or", "pass",
-        "raise", "return", "try", "while", "with", "yield"
-    };
+    shared_ptr<SymbolTable> symbolTable = make_shared<SymbolTable>();
+    bool newLine = true;
+    bool finished = false;
+    Token eofToken{};
 
     // Returns the current character without advancing
     char peek(int offset = 0) const;
@@ -55,8 +103,15 @@ private:
     // Advances to the next character and updates line/column
     char advance();
 
-    // Checks if a string is a keyword
-    bool isKeyword(const string& word);
+    // Bulk versions of advance() for runs found by the charscan scanners.
+    // advanceInLine is for runs without a newline that start mid-line;
+    // advanceAcross counts the lines it crosses
+    void advanceInLine(size_t count);
+    void advanceAcross(size_t count);
+    void skipDigits() { advanceInLine(charscan::skipDigits(cursor(), inputEnd()) - cursor()); }
+
+    const char* cursor() const { return input.data() + pos; }
+    const char* inputEnd() const { return input.data() + input.size(); }
 
     // Skips whitespace (excluding newlines)
     void skipWhitespace();
@@ -70,6 +125,10 @@ private:
     // Extracts and returns a numeric token
     Token getNumber();
 
+    // The Number token for a literal getNumber has scanned up to pos, its
+    // value decoded from the digits at digitsStart
+    Token numberToken(size_t start, size_t digitsStart, int base, bool isFloat, int startCol);
+
     // Extracts and returns a string token
     Token getString();
 
@@ -79,8 +138,27 @@ private:
     //for handling indentations
     int getIndentLevel();
 
-    // Detects types and updates symbol table entries accordingly
-    void detectTypes();
+    // Widths of the open blocks, outermost (0) first. A line indented deeper
+    // than the top pushes and emits Indent; a shallower one pops and emits a
+    // Dedent per block closed
+    vector<int> indents{0};
+    int pendingDedents = 0;
+    bool indentMismatch = false;  // the last dedent matched no open block
+    bool lineHasTokens = false;   // a Newline is owed at the end of the line
+
+    // An Indent or Dedent at the current position
+    Token layoutToken(TokenType type, int width);
+
+    // One token from the current position; nextToken() wraps it
+    Token lexToken();
+
+    // Detects types from `name = literal` assignments and `name(` definitions/calls
+    // and updates symbol table entries accordingly. Fed every token in order,
+    // it only needs the last three (recent, oldest first) plus the called IDs
+    void noteTypes(const Token& token);
+    array<Token, 3> recent{};  // value-initialised: matches no pattern
+    vector<bool> calledIds;    // indexed by symbol ID
+    bool deferCalls = false;   // keep calledIds at EOF for tokenizeParallel to merge
 
 
 signals:
@@ -85,6 +85,13 @@ ApplicationWindow {
             font.pointSize: 12
         }
 
+        CheckBox {
+            text: "Index Symbols"
+            checked: controller.symbolIndexEnabled
+            onToggled: controller.symbolIndexEnabled = checked
+            font.pointSize: 12
+        }
+
         Button {
             id: page2
             text: "⬅️"
@@ -146,9 +153,29 @@ ApplicationWindow {
                     TextArea {
                         id: codeDisplay
                         text: controller.code
-                        readOnly: true
                         wrapMode: Text.WrapAnywhere
 
+                        // The text controller.editCode last saw. Each change
+                        // typed since is passed on as the span that differs
+                        property string shown: ""
+
+                        onTextChanged: {
+                            if (text === controller.code) {
+                                shown = text
+                                return
+                            }
+                            let start = 0
+                            while (start < shown.length && start < text.length && shown[start] === text[start])
+                                ++start
+                            let oldEnd = shown.length, newEnd = text.length
+                            while (oldEnd > start && newEnd > start && shown[oldEnd - 1] === text[newEnd - 1]) {
+                                --oldEnd
+                                --newEnd
+                            }
+                            controller.editCode(start, oldEnd - start, text.substring(start, newEnd))
+                            shown = text
+                        }
+
                         font.family: "Courier New"
                         font.pointSize: 12
                         color: "white"
@@ -394,7 +421,7 @@ ApplicationWindow {
 
                 ScrollView {
                     Layout.fillWidth: true
-                    Layout.preferredHeight: parent.height
+                    Layout.preferredHeight: parent.height / 2 - 20
 
                     TextArea {
                         id: parsetree
@@ -407,6 +434,42 @@ ApplicationWindow {
                         color: "#000435"
                     }
                 }
+
+                GroupBox {
+                    title: "Find Symbol"
+                    enabled: controller.symbolIndexEnabled
+                    Layout.fillWidth: true
+                    Layout.preferredHeight: parent.height / 2 - 10
+
+                    ColumnLayout {
+                        anchors.fill: parent
+
+                        TextField {
+                            id: symbolQuery
+                            Layout.fillWidth: true
+                            placeholderText: "Name, then Enter"
+                            font.family: "Courier New"
+                            font.pointSize: 11
+                            onAccepted: symbolHits.model = controller.findSymbol(text)
+                        }
+
+                        ListView {
+                            id: symbolHits
+                            Layout.fillWidth: true
+                            Layout.fillHeight: true
+
+                            delegate: Text {
+                                text: modelData
+                                wrapMode: Text.Wrap
+
+                                font.family: "Courier New"
+                                font.pointSize: 11
+                                color: "black"
+                            }
+                            clip: true
+                        }
+                    }
+                }
             }
 
             ColumnLayout {
@@ -1,49 +1,128 @@
 #include "parser.h"
 
-Parser::Parser(vector<Token> tokens, ParserSymbolTable &symTab, QObject *parent)
-    : tokens(tokens), symbolTable(symTab) {
-    indentStack.push_back(0);
-    advance();
+Parser::Parser(TokenStream tokens, ParserSymbolTable &symTab, QObject *)
+    : tokens(move(tokens)), symbolTable(symTab) {
+    currentToken = &this->tokens.peek();
+    if (this->tokens.position() > 0) previousType = this->tokens.buffer().type(this->tokens.position() - 1);
 }
 
-Token Parser::advance() {
-    if (currentTokenIndex < tokens.size()) {
-        currentToken = tokens[currentTokenIndex++];
-    }
-    return currentToken;
+void Parser::advance() {
+    previousType = currentToken->type;
+    tokens.advance();
+    currentToken = &tokens.peek();
+}
+
+bool Parser::atLineStart() const {
+    return previousType == TokenType::Newline || previousType == TokenType::Indent ||
+           previousType == TokenType::Dedent || currentToken->type == TokenType::EOFToken;
 }
 
-void Parser::expectIndent(int expectedLevel) {
-    if (currentToken.type != TokenType::Indent) {
-        errors.emplace_back(currentToken.line, currentToken.column,
+BlockNode* Parser::parseBlock() {
+    if (!match(TokenType::Newline) || currentToken->type != TokenType::Indent) {
+        errors.emplace_back(tokens.position(), *currentToken,
                             "Expected indentation at start of block");
-        return;
+        return make<BlockNode>(tokens.position(), currentToken->value == "else");
     }
-
-    int actualLevel = stoi(currentToken.value);
-    if (actualLevel != expectedLevel) {
-        errors.emplace_back(currentToken.line, currentToken.column,
-                            "Incorrect indentation level");
+    // Each block is parsed in a scope of its own, already open
+    if (symbolTable.depth() > nestingLimit) {
+        errors.emplace_back(tokens.position(), *currentToken,
+                            "Blocks nested too deeply (limit " + to_string(nestingLimit) + ")");
+        auto block = make<BlockNode>(tokens.position(), false);
+        skipBlock();
+        return block;
     }
     advance();
-    if(currentToken.type == TokenType::Indent){
-        expectIndent(actualLevel);
-    }
+
+    auto block = make<BlockNode>(tokens.position(), currentToken->value == "else");
+    parseStatements(block);
+    match(TokenType::Dedent);
+    return block;
 }
 
-Token Parser::peek() {
-    return currentToken;
+void Parser::skipBlock() {
+    int depth = 0;
+    do {
+        if (currentToken->type == TokenType::Indent) ++depth;
+        else if (currentToken->type == TokenType::Dedent) --depth;
+        advance();
+    } while (depth > 0 && currentToken->type != TokenType::EOFToken);
+}
+
+void Parser::parseStatements(ASTNode *parent) {
+    // Collected here and copied into the arena once complete, as one array
+    vector<ASTNode*> statements;
+    BodyLayout* layout = nullptr;
+    if (layouts) {
+        layout = &(*layouts)[parent];
+        layout->scope = symbolTable.getCurrentScope();
+        layout->resume.push_back({tokens.position(), 0, uint32_t(errors.size())});
+    }
+    parseStatementsUntil(statements, layout, nullptr);
+    parent->children = arena->copy(statements);
 }
 
-Token Parser::peekNextToken() {
-    if (currentTokenIndex < tokens.size()) {
-        return tokens[currentTokenIndex];
+bool Parser::parseStatementsUntil(vector<ASTNode*>& statements, BodyLayout* layout,
+                                  const function<bool(uint32_t)>& reusable) {
+    int strayIndents = 0;  // Indents without a block header; their lines belong to this block
+    while (currentToken->type != TokenType::EOFToken) {
+        if (currentToken->type == TokenType::Dedent) {
+            if (strayIndents == 0) break;
+            --strayIndents;
+            advance();
+            continue;
+        }
+        if (currentToken->type == TokenType::Indent) {
+            errors.emplace_back(tokens.position(), *currentToken, "Unexpected indentation");
+            ++strayIndents;
+            advance();
+            continue;
+        }
+        if (match(TokenType::Newline)) continue;
+
+        if (strayIndents == 0) {
+            uint32_t at = tokens.position();
+            if (reusable && reusable(at)) return true;
+            if (layout && layout->resume.back().token != at) {
+                layout->resume.push_back({at, uint32_t(statements.size()), uint32_t(errors.size())});
+            }
+        }
+
+        auto stmt = parseStmt();
+        bool parsed = stmt != nullptr;
+        if (stmt) {
+            statements.push_back(stmt);
+        }
+
+        // Simple statements end with their line; compound ones with their block.
+        // A statement that failed has already been reported, so just drop the rest of its line
+        if (!atLineStart()) {
+            if (parsed && currentToken->type != TokenType::Newline) {
+                errors.emplace_back(tokens.position(), *currentToken, "Expected end of statement");
+            }
+            while (currentToken->type != TokenType::EOFToken && currentToken->type != TokenType::Newline &&
+                   currentToken->type != TokenType::Indent && currentToken->type != TokenType::Dedent) {
+                advance();
+            }
+            match(TokenType::Newline);
+        }
+    }
+    if (layout) {
+        layout->end = tokens.position();
+        layout->errorsEnd = uint32_t(errors.size());
     }
-    return {TokenType::EOFToken, "EOF", 0, 0};
+    return false;
+}
+
+const Token& Parser::peek() {
+    return *currentToken;
+}
+
+const Token& Parser::peekNextToken() {
+    return tokens.peek(1);
 }
 
 bool Parser::match(TokenType type, const string &value) {
-    if (currentToken.type == type && (value.empty() || currentToken.value == value)) {
+    if (currentToken->type == type && (value.empty() || currentToken->value == value)) {
         advance();
         return true;
     }
@@ -52,72 +131,98 @@ bool Parser::match(TokenType type, const string &value) {
 
 void Parser::expect(TokenType type, const string &errorMsg, const string &value) {
     if (!match(type, value)) {
-        errors.emplace_back(currentToken.line, currentToken.column, errorMsg);
+        errors.emplace_back(tokens.position(), *currentToken, errorMsg);
         synchronize();
     }
 }
 
-void Parser::synchronize() {
-    vector<string> syncKeywords = {"def", "if", "while", "return"};
-    while (currentToken.type != TokenType::EOFToken && currentToken.type != TokenType::Indent &&
-           (currentToken.type != TokenType::Keyword ||
-            find(syncKeywords.begin(), syncKeywords.end(), currentToken.value) == syncKeywords.end())) {
+bool Parser::match(Keyword keyword) {
+    if (currentToken->type == TokenType::Keyword && currentToken->keyword == keyword) {
         advance();
+        return true;
     }
+    return false;
 }
 
+void Parser::expect(Keyword keyword, const string &errorMsg) {
+    if (!match(keyword)) {
+        errors.emplace_back(tokens.position(), *currentToken, errorMsg);
+        synchronize();
+    }
+}
 
-unique_ptr<ProgramNode> Parser::parseProgram() {
-    auto program = make_unique<ProgramNode>();
-    while (currentToken.type != TokenType::EOFToken) {
-        if (currentToken.type == TokenType::Indent) {
-            expectIndent(0);  // Expect no indentation at top level
-        }
-        auto stmt = parseStmt();
-        if (stmt) {
-            program->addChild(move(stmt));
+void Parser::synchronize() {
+    while (currentToken->type != TokenType::EOFToken && currentToken->type != TokenType::Newline &&
+           currentToken->type != TokenType::Indent && currentToken->type != TokenType::Dedent) {
+        if (currentToken->type == TokenType::Keyword) {
+            switch (currentToken->keyword) {
+            case Keyword::Def:
+            case Keyword::If:
+            case Keyword::While:
+            case Keyword::Return:
+                return;
+            default:
+                break;
+            }
         }
+        advance();
     }
-    return program;
 }
 
 
-bool Parser::isValidStatementStart(const string& id) {
+Ast Parser::parseProgram() {
+    if (!keepTree) {
+        vector<ASTNode*> statements;
+        parseStatementsUntil(statements, nullptr, [&](uint32_t at) {
+            statements.clear();
+            arena->reset();
+            tokens.release(at);
+            return false;
+        });
+        arena->reset();
+    }
+    auto program = make<ProgramNode>();
+    if (keepTree) parseStatements(program);
+    return Ast{move(arena), tokens.share(), program};
+}
+
+
+bool Parser::isValidStatementStart(string_view) {
     // Allow only these identifier-starting statements:
     return peekNextToken().value == "=" ||  // Assignment
            peekNextToken().value == "(";    // Function call
 }
-unique_ptr<ASTNode> Parser::parseStmt() {
-    if (currentToken.type == TokenType::EOFToken) {
+ASTNode* Parser::parseStmt() {
+    if (currentToken->type == TokenType::EOFToken) {
         return nullptr;
     }
 
-    if (currentToken.type == TokenType::Identifier) {
-        if (!isValidStatementStart(currentToken.value)) {
-            errors.emplace_back(currentToken.line, currentToken.column,
-                                "Invalid statement starting with identifier: " + currentToken.value);
+    if (currentToken->type == TokenType::Identifier) {
+        if (!isValidStatementStart(currentToken->value)) {
+            errors.emplace_back(tokens.position(), *currentToken,
+                                "Invalid statement starting with identifier: " + string(currentToken->value));
             advance();
             return nullptr;
         }
     }
 
-    switch (currentToken.type) {
+    switch (currentToken->type) {
     case TokenType::Keyword: {
-        if (currentToken.value == "if") return parseIfStmt();
-        if (currentToken.value == "while") return parseWhileStmt();
-        if (currentToken.value == "def") return parseFuncDef();
-        if (currentToken.value == "return") return parseReturnStmt();
-        if (currentToken.value == "for") return parseForStmt();
-        if (currentToken.value == "elif" || currentToken.value == "else") {
-            //check scope
-            if(symbolTable.getCurrentScope() == "if block")
-                return nullptr; //handled in ifstmt
-            else {
-                errors.emplace_back(currentToken.line, currentToken.column,
-                                    "Unexpected token at start of statement: " +currentToken.value);
-                synchronize();
-                return nullptr;
-            }
+        switch (currentToken->keyword) {
+        case Keyword::If: return parseIfStmt();
+        case Keyword::While: return parseWhileStmt();
+        case Keyword::Def: return parseFuncDef();
+        case Keyword::Return: return parseReturnStmt();
+        case Keyword::For: return parseForStmt();
+        case Keyword::Elif:
+        case Keyword::Else:
+            // Only valid right after an if's block, where parseIfStmt takes them
+            errors.emplace_back(tokens.position(), *currentToken,
+                                "Unexpected token at start of statement: " + string(currentToken->value));
+            synchronize();
+            return nullptr;
+        default:
+            break;
         }
         break;
     }
@@ -129,58 +234,23 @@ unique_ptr<ASTNode> Parser::parseStmt() {
         }
     }
     default:
-        errors.emplace_back(currentToken.line, currentToken.column,
-                            "Unexpected token at start of statement: " +currentToken.value);
+        errors.emplace_back(tokens.position(), *currentToken,
+                            "Unexpected token at start of statement: " + string(currentToken->value));
         advance();
         return nullptr;
     }
 
-    errors.emplace_back(currentToken.line, currentToken.column,
+    errors.emplace_back(tokens.position(), *currentToken,
                         "Invalid statement");
     advance();
     return nullptr;
 }
 
-unique_ptr<ASTNode> Parser::parseFuncCall() {
-    auto funcNameToken = currentToken;
-    expect(TokenType::Identifier, "Expected function name");
-
-    if (!match(TokenType::Delimiter, "(")) {
-        errors.emplace_back(currentToken.line, currentToken.column,
-                            "Expected '(' after function name");
-        return nullptr;
-    }
-
-    vector<unique_ptr<ASTNode>> args;
-
-    if (!match(TokenType::Delimiter, ")")) {
-        do {
-            auto arg = parseExpr();
-            if (!arg) {
-                errors.emplace_back(currentToken.line, currentToken.column,
-                                    "Expected expression in function arguments");
-                break;
-            }
-            args.push_back(move(arg));
-        } while (match(TokenType::Delimiter, ","));
-
-        if (!match(TokenType::Delimiter, ")")) {
-            errors.emplace_back(currentToken.line, currentToken.column,
-                                "Expected ')' after function arguments");
-            return nullptr;
-        }
-    }
-
-    return make_unique<CallNode>(funcNameToken,
-                                 make_unique<IdentifierNode>(funcNameToken),
-                                 move(args));
-}
-
-unique_ptr<ASTNode> Parser::parseAssignStmt() {
-    auto idToken = currentToken;
+ASTNode* Parser::parseAssignStmt() {
+    uint32_t idToken = tokens.position();
     expect(TokenType::Identifier, "Expected identifier for assignment");
 
-    if (currentToken.type == TokenType::Operator && currentToken.value == "=") {
+    if (currentToken->type == TokenType::Operator && currentToken->value == "=") {
         expect(TokenType::Operator, "Expected '=' in assignment", "=");
     } else {
         expect(TokenType::Assignment, "Expected '=' in assignment", "=");
@@ -188,303 +258,167 @@ unique_ptr<ASTNode> Parser::parseAssignStmt() {
 
     auto expr = parseExpr();
     if (!expr) {
-        errors.emplace_back(currentToken.line, currentToken.column,
+        errors.emplace_back(tokens.position(), *currentToken,
                             "Expected expression after '='");
         return nullptr;
     }
 
     // Get the evaluated value and type
-    string value = evaluateExpression(expr.get());
-    string type = getTypeFromNode(expr); // Use the unified type detection
+    SymbolValue value = evaluateExpression(expr);
+    DataType type = getTypeFromNode(expr); // Use the unified type detection
 
-    if(type == "unknown")
-        type = "expr";
+    if(type == DataType::Unknown)
+        type = DataType::Expr;
     // Update symbol table with the variable information
-    symbolTable.declare(idToken.value, type, "variable", value);
+    symbolTable.declare(tokens.buffer().token(idToken), type, SymbolRole::Variable, value);
 
-    return make_unique<AssignNode>(idToken,
-                                   make_unique<IdentifierNode>(idToken),
-                                   move(expr));
+    return make<AssignNode>(idToken,
+                            make<IdentifierNode>(idToken),
+                            expr);
 }
-unique_ptr<ASTNode> Parser::parseReturnStmt() {
-    auto returnToken = currentToken;
-    expect(TokenType::Keyword, "Expected 'return' keyword", "return");
+ASTNode* Parser::parseReturnStmt() {
+    uint32_t returnToken = tokens.position();
+    expect(Keyword::Return, "Expected 'return' keyword");
 
     auto expr = parseExpr();
-    string returnValue = expr ? getValueFromNode(expr.get()) : "void";
-    string returnType = expr ? getTypeFromNode(expr) : "void";
+    SymbolValue returnValue = expr ? getValueFromNode(expr) : SymbolValue::ofText("void");
+    DataType returnType = expr ? getTypeFromNode(expr) : DataType::Void;
 
-    // Extract function name from current scope
-    string currentScope = symbolTable.getCurrentScope();
-    size_t funcSuffixPos = currentScope.find(" (function)");
-    if (funcSuffixPos != string::npos) {
-        string functionName = currentScope.substr(0, funcSuffixPos);
-
-        // Update function's return type and value in symbol table
-        auto entry = symbolTable.lookupEntry(functionName);
-        if (entry && entry->role == "function") {
-            symbolTable.updateType(functionName, returnType);
-            symbolTable.updateValue(functionName, returnValue);
+    // A return directly in a function's body sets its return type and value
+    int function = symbolTable.currentFunction();
+    if (function >= 0) {
+        auto& entry = symbolTable.entry(function);
+        if (entry.role == SymbolRole::Function) {
+            entry.dataType = returnType;
+            entry.value = returnValue;
         }
     }
 
-    return make_unique<ReturnNode>(returnToken, expr ? move(expr) : nullptr);
+    return make<ReturnNode>(returnToken, expr);
 }
 
-unique_ptr<ASTNode> Parser::parseIfStmt() {
-    auto ifToken = currentToken;
-    expect(TokenType::Keyword, "Expected 'if' keyword", "if");
+ASTNode* Parser::parseIfStmt() {
+    uint32_t ifToken = tokens.position();
+    expect(Keyword::If, "Expected 'if' keyword");
 
     auto condition = parseExpr();
     expect(TokenType::Delimiter, "Expected ':' after if condition", ":");
 
-    // Save the current indentation level before entering the if block
-    int ifIndent = indentStack.empty() ? 0 : indentStack.back();
-    int blockIndent = ifIndent + 1;
-    indentStack.push_back(blockIndent);
-
-    expectIndent(blockIndent);
-
-    symbolTable.beginScope("if block");
-
-    auto thenBlock = make_unique<BlockNode>(currentToken);
-    while (currentToken.type != TokenType::EOFToken &&
-           (currentToken.type != TokenType::Indent ||
-            stoi(currentToken.value) >= blockIndent)) {
-        if (currentToken.type == TokenType::Indent) {
-            expectIndent(blockIndent);
-            continue;
-        }
-        auto stmt = parseStmt();
-
-        if (stmt) {
-            thenBlock->addChild(move(stmt));
-        }
-        else {
-            break;
-        }
-    }
+    symbolTable.beginScope(ScopeKind::If);
+    auto thenBlock = parseBlock();
     symbolTable.endScope();
-    indentStack.pop_back();
-
-    // IMPORTANT: Only process elif/else at the same level as the original if
-    vector<unique_ptr<ElifNode>> elifBranches;
-    while (true) {
-        // Check for correct indentation level before processing elif
-        if (currentToken.type == TokenType::Indent) {
-            int currentIndent = stoi(currentToken.value);
-            if (currentIndent != ifIndent) break;
-            advance(); // Consume the indent
-        }
-
-        if (currentToken.type != TokenType::Keyword || currentToken.value != "elif") {
-            break;
-        }
 
-        auto elifToken = currentToken;
-        expect(TokenType::Keyword, "Expected 'elif' keyword", "elif");
+    // elif/else at the same level as the if follow its block directly
+    vector<ElifNode*> elifBranches;
+    while (currentToken->type == TokenType::Keyword && currentToken->keyword == Keyword::Elif) {
+        uint32_t elifToken = tokens.position();
+        expect(Keyword::Elif, "Expected 'elif' keyword");
 
         auto elifCondition = parseExpr();
         expect(TokenType::Delimiter, "Expected ':' after elif condition", ":");
 
-        int elifBlockIndent = ifIndent + 1;
-        indentStack.push_back(elifBlockIndent);
-
-        expectIndent(elifBlockIndent);
-
-        symbolTable.beginScope("elif block");
-
-        auto elifBlock = make_unique<BlockNode>(currentToken);
-        while (currentToken.type != TokenType::EOFToken &&
-               (currentToken.type != TokenType::Indent ||
-                stoi(currentToken.value) >= elifBlockIndent)) {
-            if (currentToken.type == TokenType::Indent) {
-                expectIndent(elifBlockIndent);
-                continue;
-            }
-            auto stmt = parseStmt();
-
-            if (stmt) {
-                elifBlock->addChild(move(stmt));
-            }
-        }
-
+        symbolTable.beginScope(ScopeKind::Elif);
+        auto elifBlock = parseBlock();
         symbolTable.endScope();
-        indentStack.pop_back();
 
-        elifBranches.push_back(make_unique<ElifNode>(elifToken, move(elifCondition), move(elifBlock)));
+        elifBranches.push_back(make<ElifNode>(elifToken, elifCondition, elifBlock));
     }
 
-    // Check for else at the same level as the original if
-    unique_ptr<ASTNode> elseBlock = nullptr;
-    if (currentToken.type == TokenType::Indent) {
-        int currentIndent = stoi(currentToken.value);
-        if (currentIndent == ifIndent) {
-            advance(); // Consume the indent
-            if (currentToken.type == TokenType::Keyword && currentToken.value == "else") {
-                elseBlock = parseElseStmt();
-            }
-        }
-    }
-    else if (currentToken.type == TokenType::Keyword && currentToken.value == "else") {
+    ASTNode* elseBlock = nullptr;
+    if (currentToken->type == TokenType::Keyword && currentToken->keyword == Keyword::Else) {
         elseBlock = parseElseStmt();
     }
 
-    return make_unique<IfNode>(ifToken, move(condition), move(thenBlock), move(elseBlock), move(elifBranches));
+    return make<IfNode>(ifToken, condition, thenBlock, elseBlock, elifBranches);
 }
 
-unique_ptr<ASTNode> Parser::parseElseStmt() {
-    auto elseToken = currentToken;
-    expect(TokenType::Keyword, "Expected 'else' keyword", "else");
+ASTNode* Parser::parseElseStmt() {
+    expect(Keyword::Else, "Expected 'else' keyword");
     expect(TokenType::Delimiter, "Expected ':' after else", ":");
 
-    int currentIndent = indentStack.empty() ? 0 : indentStack.back();
-    int blockIndent = currentIndent + 1;
-    indentStack.push_back(blockIndent);
-
-    expectIndent(blockIndent);
-
-    symbolTable.beginScope("else block");
-
-    auto elseBlock = make_unique<BlockNode>(currentToken);
-    while (currentToken.type != TokenType::EOFToken &&
-           (currentToken.type != TokenType::Indent ||
-            stoi(currentToken.value) >= blockIndent)) {
-        if (currentToken.type == TokenType::Indent) {
-            expectIndent(blockIndent);
-            continue;
-        }
-        auto stmt = parseStmt();
-        if (stmt) {
-            elseBlock->addChild(move(stmt));
-        }
-    }
-
+    symbolTable.beginScope(ScopeKind::Else);
+    auto elseBlock = parseBlock();
     symbolTable.endScope();
-    indentStack.pop_back();
 
     return elseBlock;
 }
 
-unique_ptr<ASTNode> Parser::parseForStmt() {
-    auto forToken = currentToken;
-    expect(TokenType::Keyword, "Expected 'for' keyword", "for");
+ASTNode* Parser::parseForStmt() {
+    uint32_t forToken = tokens.position();
+    expect(Keyword::For, "Expected 'for' keyword");
 
     // Parse loop variable
     auto var = parsePrimary(); // Should be an identifier
-    if (!var || !dynamic_cast<IdentifierNode*>(var.get())) {
-        errors.emplace_back(currentToken.line, currentToken.column,
+    if (!var || var->kind != NodeKind::Identifier) {
+        errors.emplace_back(tokens.position(), *currentToken,
                             "Expected identifier after 'for'");
         return nullptr;
     }
 
-    expect(TokenType::Keyword, "Expected 'in' after loop variable", "in");
+    expect(Keyword::In, "Expected 'in' after loop variable");
 
     // Parse iterable expression
     auto iterable = parseExpr();
     if (!iterable) {
-        errors.emplace_back(currentToken.line, currentToken.column,
+        errors.emplace_back(tokens.position(), *currentToken,
                             "Expected iterable expression after 'in'");
         return nullptr;
     }
 
     expect(TokenType::Delimiter, "Expected ':' after for loop header", ":");
 
-    // Handle indentation and block
-    int currentIndent = indentStack.empty() ? 0 : indentStack.back();
-    int blockIndent = currentIndent + 1;
-    indentStack.push_back(blockIndent);
-
-    expectIndent(blockIndent);
-
-    symbolTable.beginScope("for loop");
-
-    auto body = make_unique<BlockNode>(currentToken);
-    while (currentToken.type != TokenType::EOFToken &&
-           (currentToken.type != TokenType::Indent ||
-            stoi(currentToken.value) >= blockIndent)) {
-        if (currentToken.type == TokenType::Indent) {
-            expectIndent(blockIndent);
-            continue;
-        }
-        auto stmt = parseStmt();
-        if (stmt) body->addChild(move(stmt));
-    }
-
+    symbolTable.beginScope(ScopeKind::For);
+    auto body = parseBlock();
     symbolTable.endScope();
-    indentStack.pop_back();
 
-    return make_unique<ForNode>(forToken, move(var), move(iterable), move(body));
+    return make<ForNode>(forToken, var, iterable, body);
 }
 
-unique_ptr<ASTNode> Parser::parseWhileStmt() {
-    auto whileToken = currentToken;
-    expect(TokenType::Keyword, "Expected 'while' keyword", "while");
+ASTNode* Parser::parseWhileStmt() {
+    uint32_t whileToken = tokens.position();
+    expect(Keyword::While, "Expected 'while' keyword");
 
     auto condition = parseExpr();
     expect(TokenType::Delimiter, "Expected ':' after while condition", ":");
 
-    // Get current indentation level
-    int currentIndent = indentStack.empty() ? 0 : indentStack.back();
-    int blockIndent = currentIndent + 1;
-    indentStack.push_back(blockIndent);
-
-    // Expect indentation for the block
-    expectIndent(blockIndent);
-
     // Enter new scope for while block
-    symbolTable.beginScope("while block");
-
-    auto body = make_unique<BlockNode>(currentToken);
-    while (currentToken.type != TokenType::EOFToken &&
-           (currentToken.type != TokenType::Indent ||
-            stoi(currentToken.value) >= blockIndent)) {
-        if (currentToken.type == TokenType::Indent) {
-            expectIndent(blockIndent);
-            continue;
-        }
-        auto stmt = parseStmt();
-        if (stmt) body->addChild(move(stmt));
-    }
-
-    // Exit while block scope
+    symbolTable.beginScope(ScopeKind::While);
+    auto body = parseBlock();
     symbolTable.endScope();
-    indentStack.pop_back();
 
-    return make_unique<WhileNode>(whileToken, move(condition), move(body));
+    return make<WhileNode>(whileToken, condition, body);
 }
 
-unique_ptr<ASTNode> Parser::parseFuncDef() {
-    auto defToken = currentToken;
-    expect(TokenType::Keyword, "Expected 'def' keyword", "def");
-
-    auto funcNameToken = currentToken;
-    expect(TokenType::Identifier, "Expected function name after 'def'");
+ASTNode* Parser::parseFuncDef() {
+    uint32_t defToken = tokens.position();
+    expect(Keyword::Def, "Expected 'def' keyword");
 
     // Add function to symbol table with unknown return value initially
-    symbolTable.declare(funcNameToken.value, "function", "function", "unknown");
+    uint32_t funcNameToken = tokens.position();
+    int function = symbolTable.declare(*currentToken, DataType::Function, SymbolRole::Function);
+    expect(TokenType::Identifier, "Expected function name after 'def'");
 
     // Enter new scope for function
-    symbolTable.beginScope(funcNameToken.value + " (function)");
+    symbolTable.beginScope(ScopeKind::Function, function);
 
     expect(TokenType::Delimiter, "Expected '(' after function name", "(");
 
-    vector<string> paramNames;
-    if (currentToken.type == TokenType::Identifier) {
+    vector<uint32_t> params;
+    if (currentToken->type == TokenType::Identifier) {
         // Add parameter to symbol table
-        symbolTable.declare(currentToken.value, "unknown", "parameter");
-        paramNames.push_back(currentToken.value);
+        symbolTable.declare(*currentToken, DataType::Unknown, SymbolRole::Parameter);
+        params.push_back(tokens.position());
         advance();
 
         while (match(TokenType::Delimiter, ",")) {
-            if (currentToken.type != TokenType::Identifier) {
-                errors.emplace_back(currentToken.line, currentToken.column,
+            if (currentToken->type != TokenType::Identifier) {
+                errors.emplace_back(tokens.position(), *currentToken,
                                     "Expected parameter name after ','");
                 break;
             }
             // Add parameter to symbol table
-            symbolTable.declare(currentToken.value, "unknown", "parameter");
-            paramNames.push_back(currentToken.value);
+            symbolTable.declare(*currentToken, DataType::Unknown, SymbolRole::Parameter);
+            params.push_back(tokens.position());
             advance();
         }
     }
@@ -492,256 +426,373 @@ unique_ptr<ASTNode> Parser::parseFuncDef() {
     expect(TokenType::Delimiter, "Expected ')' after parameter list", ")");
     expect(TokenType::Delimiter, "Expected ':' after function definition", ":");
 
-    // Get current indentation level
-    int currentIndent = indentStack.empty() ? 0 : indentStack.back();
-    int blockIndent = currentIndent + 1;
-    indentStack.push_back(blockIndent);
-
-    // Expect indentation for the block
-    expectIndent(blockIndent);
-
-    auto body = make_unique<BlockNode>(currentToken);
-    while (currentToken.type != TokenType::EOFToken &&
-           (currentToken.type != TokenType::Indent ||
-            stoi(currentToken.value) >= blockIndent)) {
-        if (currentToken.type == TokenType::Indent) {
-            expectIndent(blockIndent);
-            continue;
-        }
-        auto stmt = parseStmt();
-        if (stmt) body->addChild(move(stmt));
+    // A body that starts as parseBlock() expects is left for later
+    if (bodies && currentToken->type == TokenType::Newline && peekNextToken().type == TokenType::Indent) {
+        auto node = make<FunctionDefNode>(defToken, funcNameToken, params, nullptr);
+        node->bodies = bodies;
+        node->bodyToken = tokens.position();
+        node->scope = symbolTable.getCurrentScope();
+        advance();
+        skipBlock();
+        symbolTable.endScope();
+        return node;
     }
 
+    auto body = parseBlock();
+
     // Exit function scope
     symbolTable.endScope();
-    indentStack.pop_back();
 
-    return make_unique<FunctionDefNode>(defToken, funcNameToken.value, move(paramNames), move(body));
+    return make<FunctionDefNode>(defToken, funcNameToken, params, body);
+}
+
+ASTNode* BodyParser::parse(const FunctionDefNode& function) {
+    int reopened = symbols->reopenScopes(function.scope);
+    Parser parser(TokenStream(tokens, function.bodyToken), *symbols);
+    parser.useArena(move(arena));
+    parser.skipBodies(*this);
+    ASTNode* body = parser.parseBlock();
+    arena = parser.takeArena();
+    for (int i = 0; i < reopened; ++i) symbols->endScope();
+
+    vector<ParseError> found = parser.takeErrors();
+    errors.insert(errors.end(), make_move_iterator(found.begin()), make_move_iterator(found.end()));
+    return body;
 }
 
-unique_ptr<ASTNode> Parser::parseFuncCallStmt() {
-    auto funcNameToken = currentToken;
+ASTNode* FunctionDefNode::parseBody() const {
+    ASTNode* body = bodies->parse(*this);
+    const_cast<ASTNode**>(children.data())[1] = body;
+    return body;
+}
+
+ASTNode* Parser::parseFuncCallStmt() {
+    uint32_t funcNameToken = tokens.position();
     expect(TokenType::Identifier, "Expected identifier for function call");
 
     expect(TokenType::Delimiter, "Expected '(' in function call", "(");
 
-    vector<unique_ptr<ASTNode>> args;
+    vector<ASTNode*> args;
     if (!match(TokenType::Delimiter, ")")) {
         do {
             auto arg = parseExpr();
             if (!arg) {
-                errors.emplace_back(currentToken.line, currentToken.column,
+                errors.emplace_back(tokens.position(), *currentToken,
                                     "Expected expression in function arguments");
                 break;
             }
-            args.push_back(move(arg));
+            args.push_back(arg);
         } while (match(TokenType::Delimiter, ","));
 
         expect(TokenType::Delimiter, "Expected ')' after arguments", ")");
     }
 
-    // Look up function return type if it exists
-    string returnType = "unknown";
-    auto funcEntry = symbolTable.lookupEntry(funcNameToken.value);
-    if (funcEntry && funcEntry->role == "function") {
-        returnType = funcEntry->dataType;
-    } else {
-        symbolTable.declare(funcNameToken.value, "unknown", "function", "unknown");
-    }
-
-    return make_unique<CallNode>(funcNameToken,
-                                 make_unique<IdentifierNode>(funcNameToken),
-                                 move(args));
-}
-
-unique_ptr<ASTNode> Parser::parseExpr() {
-    if (currentToken.type == TokenType::EOFToken) {
-        errors.emplace_back(currentToken.line, currentToken.column,
-                            "Unexpected end of file while parsing expression");
-        return nullptr;
-    }
-    return parseLogicalOr();
-}
-
-
-unique_ptr<ASTNode> Parser::parseLogicalOr() {
-    auto node = parseLogicalAnd();
-    if (!node) return nullptr;
-
-    Token op = currentToken;
-    while (match(TokenType::Keyword, "or")) {
-        auto right = parseLogicalAnd();
-        if (!right) {
-            errors.emplace_back(currentToken.line, currentToken.column,
-                                "Expected right-hand expression after 'or'");
-            return node;  // Return what we have so far
+    // Calls to names not yet declared as functions declare them
+    auto funcEntry = symbolTable.lookupEntry(tokens.buffer().symbolId(funcNameToken));
+    if (!funcEntry || funcEntry->role != SymbolRole::Function) {
+        symbolTable.declare(tokens.buffer().token(funcNameToken), DataType::Unknown, SymbolRole::Function);
+    }
+
+    return make<CallNode>(funcNameToken,
+                          make<IdentifierNode>(funcNameToken),
+                          args);
+}
+
+void Parser::redeclare(ASTNode* statements) {
+    // What is left to do, last first: a statement, a block parsed in a
+    // scope of its own, or closing that scope after its statements
+    struct Step {
+        enum class Kind : uint8_t { Statement, Block, EndScope };
+        Kind kind;
+        ASTNode* node;
+        ScopeKind scope;  // Block
+    };
+    vector<Step> pending;
+    auto addStatements = [&](ASTNode* body) {
+        for (size_t i = body->children.size(); i > 0; --i) {
+            if (body->children[i - 1]) pending.push_back({Step::Kind::Statement, body->children[i - 1], {}});
+        }
+    };
+    addStatements(statements);
+
+    const TokenBuffer& buffer = tokens.buffer();
+    while (!pending.empty()) {
+        Step step = pending.back();
+        pending.pop_back();
+        if (step.kind == Step::Kind::EndScope) {
+            symbolTable.endScope();
+            continue;
         }
-        node = make_unique<BinaryOpNode>(op, move(node), move(right));
-    }
-    return node;
-}
-
-unique_ptr<ASTNode> Parser::parseLogicalAnd() {
-    auto node = parseEquality();
-    if (!node) return nullptr;
-    Token op = currentToken;
-    while (match(TokenType::Keyword, "and")) {
-        cout<<"hhh"<<endl;
-        auto right = parseEquality();
-        if (!right) {
-            errors.emplace_back(currentToken.line, currentToken.column,
-                                "Expected right-hand expression after 'and'");
-            return node;  // Return what we have so far
+        if (step.kind == Step::Kind::Block) {
+            symbolTable.beginScope(step.scope);
+            pending.push_back({Step::Kind::EndScope, nullptr, {}});
+            addStatements(step.node);
+            continue;
         }
-        node = make_unique<BinaryOpNode>(op, move(node), move(right));
-    }
-    return node;
-}
-unique_ptr<ASTNode> Parser::parseEquality() {
-    auto node = parseRelational();
-    if (!node) return nullptr;
 
-    while (true) {
-        Token op = currentToken;
-        if (match(TokenType::Operator, "==") || match(TokenType::Operator, "!=")) {
-            //Token op = currentToken;
-            auto right = parseRelational();
-            if (!right) {
-                errors.emplace_back(currentToken.line, currentToken.column,
-                                    "Expected right-hand expression after operator");
-                return nullptr;
+        ASTNode* node = step.node;
+        switch (node->kind) {
+        case NodeKind::Assign: {
+            // As parseAssignStmt
+            ASTNode* expr = node->children[1];
+            SymbolValue value = evaluateExpression(expr);
+            DataType type = getTypeFromNode(expr);
+            if (type == DataType::Unknown) type = DataType::Expr;
+            symbolTable.declare(buffer.token(node->children[0]->token), type, SymbolRole::Variable, value);
+            break;
+        }
+        case NodeKind::Call: {
+            // As parseFuncCallStmt
+            auto funcEntry = symbolTable.lookupEntry(symbolOf(node));
+            if (!funcEntry || funcEntry->role != SymbolRole::Function) {
+                symbolTable.declare(buffer.token(node->token), DataType::Unknown, SymbolRole::Function);
             }
-            node = make_unique<BinaryOpNode>(op, move(node), move(right));
-        } else {
             break;
         }
-    }
-    return node;
-}
-
-unique_ptr<ASTNode> Parser::parseRelational() {
-    auto node = parseTerm();
-    if (!node) return nullptr;
-
-    while (true) {
-        Token op = currentToken;
-        if (match(TokenType::Operator, "<") || match(TokenType::Operator, ">") ||
-            match(TokenType::Operator, "<=") || match(TokenType::Operator, ">=")) {
-            //Token op = currentToken;
-            auto right = parseTerm();
-            if (!right) {
-                errors.emplace_back(currentToken.line, currentToken.column,
-                                    "Expected right-hand expression after comparison");
-                return nullptr;
+        case NodeKind::Return: {
+            // As parseReturnStmt
+            ASTNode* expr = node->children.empty() ? nullptr : node->children[0];
+            int function = symbolTable.currentFunction();
+            if (function >= 0 && symbolTable.entry(function).role == SymbolRole::Function) {
+                SymbolValue returnValue = expr ? getValueFromNode(expr) : SymbolValue::ofText("void");
+                DataType returnType = expr ? getTypeFromNode(expr) : DataType::Void;
+                auto& entry = symbolTable.entry(function);
+                entry.dataType = returnType;
+                entry.value = returnValue;
             }
-            node = make_unique<BinaryOpNode>(op, move(node), move(right));
-        } else {
+            break;
+        }
+        case NodeKind::If: {
+            // Children: condition, then block, elif branches, else block if any
+            size_t elifEnd = node->children.size();
+            if (elifEnd > 2 && node->children[elifEnd - 1]->kind != NodeKind::Elif) {
+                pending.push_back({Step::Kind::Block, node->children[--elifEnd], ScopeKind::Else});
+            }
+            for (size_t i = elifEnd; i > 2; --i) {
+                pending.push_back({Step::Kind::Block, node->children[i - 1]->children[1], ScopeKind::Elif});
+            }
+            pending.push_back({Step::Kind::Block, node->children[1], ScopeKind::If});
+            break;
+        }
+        case NodeKind::While:
+            pending.push_back({Step::Kind::Block, node->children[1], ScopeKind::While});
+            break;
+        case NodeKind::For:
+            pending.push_back({Step::Kind::Block, node->children[2], ScopeKind::For});
+            break;
+        case NodeKind::FunctionDef: {
+            // As parseFuncDef
+            auto def = static_cast<FunctionDefNode*>(node);
+            int function = symbolTable.declare(buffer.token(def->children[0]->token), DataType::Function,
+                                               SymbolRole::Function);
+            symbolTable.beginScope(ScopeKind::Function, function);
+            for (uint32_t param : def->params) {
+                symbolTable.declare(buffer.token(param), DataType::Unknown, SymbolRole::Parameter);
+            }
+            pending.push_back({Step::Kind::EndScope, nullptr, {}});
+            addStatements(def->getBody());
+            break;
+        }
+        default:
             break;
         }
     }
-    return node;
 }
 
-unique_ptr<ASTNode> Parser::parseTerm() {
-    auto node = parseFactor();
-    if (!node) return nullptr;
+ASTNode* Parser::parseExpr() {
+    return parseNested(false);
+}
 
+ASTNode* Parser::parsePrimary() {
+    return parseNested(true);
+}
+
+ASTNode* Parser::parseNested(bool primary) {
+    using Step = ExprFrame::Step;
+    exprStack.clear();
+    size_t waiting = 0;  // frames waiting for an operand
+    bool reported = false;
+    auto nest = [&]() {
+        if (++waiting > nestingLimit && !reported) {
+            errors.emplace_back(tokens.position(), *currentToken,
+                                "Expression nested too deeply (limit " + to_string(nestingLimit) + ")");
+            reported = true;
+        }
+    };
+
+    // Down to the first atom of a whole expression, of an operand binding
+    // tighter than min, or of a primary; then up, handing result to the
+    // innermost frame until one wants another operand
+    enum class Next { Whole, Operand, Primary, Up } next = primary ? Next::Primary : Next::Whole;
+    Precedence min = Precedence::None;
+    ASTNode* result = nullptr;
     while (true) {
-        Token op = currentToken;
-        if (match(TokenType::Operator, "+") || match(TokenType::Operator, "-")) {
-            //Token op = currentToken;
-            auto right = parseFactor();
-            if (!right) {
-                errors.emplace_back(currentToken.line, currentToken.column,
-                                    "Expected right-hand expression after operator");
-                return nullptr;
+        switch (next) {
+        case Next::Whole:
+            if (currentToken->type == TokenType::EOFToken) {
+                errors.emplace_back(tokens.position(), *currentToken,
+                                    "Unexpected end of file while parsing expression");
+                result = nullptr;
+                next = Next::Up;
+                continue;
             }
-            node = make_unique<BinaryOpNode>(op, move(node), move(right));
-        } else {
+            min = Precedence::None;
+            [[fallthrough]];
+        case Next::Operand:
+            exprStack.push_back({Step::Left, min, int(Precedence::Factor) + 1, OperatorKind::None, 0, nullptr, 0});
+            while (operatorInfo(operatorOf(*currentToken)).prefix) {
+                exprStack.push_back({Step::Prefix, min, 0, OperatorKind::None, tokens.position(), nullptr, 0});
+                nest();
+                advance();
+            }
+            [[fallthrough]];
+        case Next::Primary:
+            if (currentToken->type == TokenType::Identifier && peekNextToken().value == "(") {
+                uint32_t name = tokens.position();
+                advance();
+                if (!match(TokenType::Delimiter, "(")) {
+                    errors.emplace_back(tokens.position(), *currentToken,
+                                        "Expected '(' after function name");
+                    result = nullptr;
+                } else if (match(TokenType::Delimiter, ")")) {
+                    result = make<CallNode>(name, make<IdentifierNode>(name), vector<ASTNode*>());
+                } else {
+                    exprStack.push_back({Step::Arguments, min, 0, OperatorKind::None, name, nullptr,
+                                         uint32_t(exprArguments.size())});
+                    nest();
+                    next = Next::Whole;
+                    continue;
+                }
+            } else if (match(TokenType::Delimiter, "(")) {
+                exprStack.push_back({Step::Parentheses, min, 0, OperatorKind::None, 0, nullptr, 0});
+                nest();
+                next = Next::Whole;
+                continue;
+            } else {
+                result = parseAtom();
+            }
+            next = Next::Up;
+            continue;
+        case Next::Up:
             break;
         }
-    }
-    return node;
-}
-
-unique_ptr<ASTNode> Parser::parseFactor() {
-    auto node = parseUnary();
-    if (!node) return nullptr;
 
-    while (true) {
-        Token op = currentToken;
-        if (match(TokenType::Operator, "*") || match(TokenType::Operator, "/") ||
-            match(TokenType::Operator, "%")) {
-            //Token op = currentToken;
-            auto right = parseUnary();
-            if (!right) {
-                errors.emplace_back(currentToken.line, currentToken.column,
-                                    "Expected right-hand expression after operator");
-                return nullptr;
+        if (exprStack.empty()) return result;
+        ExprFrame& frame = exprStack.back();
+        switch (frame.step) {
+        case Step::Prefix:
+            if (result) {
+                result = make<UnaryOpNode>(frame.token, result);
+            } else {
+                errors.emplace_back(tokens.position(), *currentToken,
+                                    "Expected expression after unary operator");
+            }
+            exprStack.pop_back();
+            --waiting;
+            continue;
+        case Step::Parentheses:
+            exprStack.pop_back();
+            --waiting;
+            expect(TokenType::Delimiter, "Expected ')' after expression", ")");
+            continue;
+        case Step::Arguments:
+            if (!result) {
+                errors.emplace_back(tokens.position(), *currentToken,
+                                    "Expected expression in function arguments");
+            } else {
+                exprArguments.push_back(result);
+                if (match(TokenType::Delimiter, ",")) {
+                    next = Next::Whole;
+                    continue;
+                }
+            }
+            if (match(TokenType::Delimiter, ")")) {
+                vector<ASTNode*> args(exprArguments.begin() + frame.arguments, exprArguments.end());
+                result = make<CallNode>(frame.token, make<IdentifierNode>(frame.token), args);
+            } else {
+                errors.emplace_back(tokens.position(), *currentToken,
+                                    "Expected ')' after function arguments");
+                result = nullptr;
+            }
+            exprArguments.resize(frame.arguments);
+            exprStack.pop_back();
+            --waiting;
+            continue;
+        case Step::Right: {
+            --waiting;
+            const OperatorInfo& op = operatorInfo(frame.op);
+            if (!result) {
+                errors.emplace_back(tokens.position(), *currentToken, string(op.missingRight));
+                if (!op.keepsLeft) {
+                    exprStack.pop_back();
+                    continue;
+                }
+                frame.ceiling = int(op.binary);  // Keep what we have so far
+            } else {
+                frame.node = make<BinaryOpNode>(frame.token, frame.node, result);
+                frame.ceiling = int(op.binary) + 1;
             }
-            node = make_unique<BinaryOpNode>(op, move(node), move(right));
-        } else {
             break;
         }
-    }
-    return node;
-}
+        case Step::Left:
+            if (!result) {
+                exprStack.pop_back();
+                continue;
+            }
+            frame.node = result;
+            break;
+        }
 
-unique_ptr<ASTNode> Parser::parseUnary() {
-    Token op = currentToken;
-    if (match(TokenType::Operator, "-") || match(TokenType::Keyword, "not")) {
-        //Token op = currentToken;
-        auto right = parseUnary();
-        if (!right) {
-            errors.emplace_back(currentToken.line, currentToken.column,
-                                "Expected expression after unary operator");
-            return nullptr;
+        // Operators looser than the frame's ceiling continue its expression;
+        // after a binary operator only those no tighter than it do, as the
+        // right operand took the rest
+        OperatorKind kind = operatorOf(*currentToken);
+        int precedence = int(operatorInfo(kind).binary);
+        if (precedence <= int(frame.min) || precedence >= frame.ceiling) {
+            result = frame.node;
+            exprStack.pop_back();
+            continue;
         }
-        return make_unique<UnaryOpNode>(op, move(right));
+        frame.step = Step::Right;
+        frame.op = kind;
+        frame.token = tokens.position();
+        nest();
+        advance();
+        min = operatorInfo(kind).binary;
+        next = Next::Operand;
     }
-    return parsePrimary();
 }
 
-unique_ptr<ASTNode> Parser::parsePrimary() {
-    if (currentToken.type == TokenType::Number) {
-        Token numToken = currentToken;
+ASTNode* Parser::parseAtom() {
+    if (currentToken->type == TokenType::Number) {
+        auto node = make<NumberNode>(tokens.position(), currentToken->number);
         advance();
-        try {
-            return make_unique<NumberNode>(numToken);
-        } catch (...) {
-            errors.emplace_back(numToken.line, numToken.column,
-                                "Invalid number format");
-            return nullptr;
-        }
+        return node;
     }
-    if (currentToken.type == TokenType::String) {
-        Token strToken = currentToken;
+    if (currentToken->type == TokenType::String) {
+        auto node = make<StringNode>(tokens.position());
         advance();
-        return make_unique<StringNode>(strToken);
+        return node;
     }
-    if (currentToken.type == TokenType::Keyword &&
-        (currentToken.value == "True" || currentToken.value == "False")) {
-        Token boolToken = currentToken;
+    if (currentToken->type == TokenType::Keyword &&
+        (currentToken->keyword == Keyword::True || currentToken->keyword == Keyword::False)) {
+        auto node = make<BooleanNode>(tokens.position());
         advance();
-        return make_unique<BooleanNode>(boolToken);
+        return node;
     }
-    if (currentToken.type == TokenType::Identifier) {
-        if (peekNextToken().value == "(") {
-            return parseFuncCall();
-        }
-        Token idToken = currentToken;
+    if (currentToken->type == TokenType::Identifier) {
+        auto node = make<IdentifierNode>(tokens.position());
         advance();
-        return make_unique<IdentifierNode>(idToken);
-    }
-    if (match(TokenType::Delimiter, "(")) {
-        auto expr = parseExpr();
-        expect(TokenType::Delimiter, "Expected ')' after expression", ")");
-        return expr;
+        return node;
     }
 
-    errors.emplace_back(currentToken.line, currentToken.column,
+    errors.emplace_back(tokens.position(), *currentToken,
                         "Unexpected token in expression");
-    advance();
+    // Line and block structure is left for the statement loop
+    if (currentToken->type != TokenType::Newline && currentToken->type != TokenType::Indent &&
+        currentToken->type != TokenType::Dedent && currentToken->type != TokenType::EOFToken) {
+        advance();
+    }
     return nullptr;
 }
 
@@ -763,130 +814,176 @@ void Parser::printErrors() {
     }
 }
 
-string Parser::getValueFromNode(ASTNode* node) {
-    if (!node) return "unknown";
+SymbolValue Parser::getValueFromNode(ASTNode* node) {
+    if (!node) return {};
 
-    if (auto numNode = dynamic_cast<NumberNode*>(node)) {
-        return to_string(numNode->getValue());
-    } else if (auto strNode = dynamic_cast<StringNode*>(node)) {
-        return strNode->getToken().value;
-    } else if (auto boolNode = dynamic_cast<BooleanNode*>(node)) {
-        return boolNode->getToken().value;
-    } else if (auto idNode = dynamic_cast<IdentifierNode*>(node)) {
-        return idNode->getToken().value;
-    } else if (auto callNode = dynamic_cast<CallNode*>(node)) {
+    switch (node->kind) {
+    case NodeKind::Number:
+        return SymbolValue::ofNumber(static_cast<NumberNode*>(node)->getValue());
+    case NodeKind::String:
+    case NodeKind::Identifier:
+        return SymbolValue::ofText(text(node));
+    case NodeKind::Boolean:
+        return SymbolValue::ofBoolean(tokens.buffer().keyword(node->token) == Keyword::True);
+    case NodeKind::Call: {
         // Look up function return type
-        auto entry = symbolTable.lookupEntry(callNode->getToken().value);
-        return (entry && entry->role == "function") ? entry->value : "unknown";
+        auto entry = symbolTable.lookupEntry(symbolOf(node));
+        return (entry && entry->role == SymbolRole::Function) ? entry->value : SymbolValue();
+    }
+    default:
+        return {};
     }
-    return "unknown";
 }
 
-string Parser::getTypeFromNode(const unique_ptr<ASTNode>& node) {
-    if (!node) return "unknown";
+DataType Parser::getTypeFromNode(ASTNode* node) {
+    if (!node) return DataType::Unknown;
 
-    if (auto numNode = dynamic_cast<NumberNode*>(node.get())) {
-        return numNode->getValueType();
+    switch (node->kind) {
+    case NodeKind::Number:
+        return static_cast<NumberNode*>(node)->number.isInteger() ? DataType::Int : DataType::Float;
+    case NodeKind::String:
+        return DataType::String;
+    case NodeKind::Boolean:
+        return DataType::Boolean;
+    case NodeKind::Identifier: {
+        // Look up identifier type in symbol table
+        auto entry = symbolTable.lookupEntry(symbolOf(node));
+        return entry ? entry->dataType : DataType::Unknown;
     }
-    else if (dynamic_cast<StringNode*>(node.get())) {
-        return "string";
+    case NodeKind::Call: {
+        // Look up function return type
+        auto entry = symbolTable.lookupEntry(symbolOf(node));
+        return (entry && entry->role == SymbolRole::Function) ? entry->dataType : DataType::Unknown;
     }
-    else if (dynamic_cast<BooleanNode*>(node.get())) {
-        return "boolean";
+    default:
+        return DataType::Unknown;
     }
-    else if (dynamic_cast<IdentifierNode*>(node.get())) {
-        // Look up identifier type in symbol table
-        auto entry = symbolTable.lookupEntry(node->getToken().value);
-        return entry ? entry->dataType : "unknown";
+}
+
+bool Parser::numericValue(ASTNode* node, double& value, size_t depth) {
+    if (!node || depth > nestingLimit) return false;
+
+    switch (node->kind) {
+    case NodeKind::Number:
+        value = static_cast<NumberNode*>(node)->getValue();
+        return true;
+    case NodeKind::UnaryOp: {
+        auto unOp = static_cast<UnaryOpNode*>(node);
+        string_view op = text(unOp);
+        if ((op != "-" && op != "+") || !numericValue(unOp->getOperand(), value, depth + 1)) return false;
+        if (op == "-") value = -value;
+        return true;
     }
-    else if (auto callNode = dynamic_cast<CallNode*>(node.get())) {
-        // Look up function return type
-        auto entry = symbolTable.lookupEntry(callNode->getToken().value);
-        return (entry && entry->role == "function") ? entry->dataType : "unknown";
+    case NodeKind::BinaryOp: {
+        auto binOp = static_cast<BinaryOpNode*>(node);
+        string_view op = text(binOp);
+        double left, right;
+        if (op.size() != 1 || string_view("+-*/%").find(op[0]) == string_view::npos ||
+            !numericValue(binOp->getLeft(), left, depth + 1) || !numericValue(binOp->getRight(), right, depth + 1)) {
+            return false;
+        }
+        switch (op[0]) {
+        case '+': value = left + right; return true;
+        case '-': value = left - right; return true;
+        case '*': value = left * right; return true;
+        case '/':
+            if (right == 0) return false;  // evaluateExpression reports it
+            value = left / right;
+            return true;
+        default:
+            if ((int)right == 0) return false;
+            value = (int)left % (int)right;
+            return true;
+        }
+    }
+    case NodeKind::Identifier: {
+        auto entry = symbolTable.lookupEntry(symbolOf(node));
+        if (!entry || entry->value.kind != SymbolValue::Kind::Number) return false;
+        value = entry->value.number;
+        return true;
     }
-    return "unknown";
+    default:
+        return false;
+    }
+}
+
+// How and/or/not read an operand: True, or the text "True" or "1"
+static bool isTruthy(const SymbolValue& value) {
+    if (value.kind == SymbolValue::Kind::Boolean) return value.boolean;
+    string_view text = value.textView();
+    return text == "True" || text == "1";
 }
 
-string Parser::evaluateExpression(ASTNode* node) {
-    if (!node) return "unknown";
+SymbolValue Parser::evaluateExpression(ASTNode* node, size_t depth) {
+    if (!node || depth > nestingLimit) return {};
 
+    // Arithmetic is done on numbers; text is only for the result
+    double number;
+    if (numericValue(node, number, depth)) return SymbolValue::ofNumber(number);
+
+    switch (node->kind) {
     // Handle binary operations
-    if (auto binOp = dynamic_cast<BinaryOpNode*>(node)) {
-        string left = evaluateExpression(binOp->getLeft());
-        string right = evaluateExpression(binOp->getRight());
-        string op = binOp->getOp().value;
+    case NodeKind::BinaryOp: {
+        auto binOp = static_cast<BinaryOpNode*>(node);
+        string_view op = text(binOp);
+
+        double leftNum, rightNum;
+        if (op != "and" && op != "or" &&
+            numericValue(binOp->getLeft(), leftNum, depth + 1) && numericValue(binOp->getRight(), rightNum, depth + 1)) {
+            if (op == "/" || op == "%") return SymbolValue::ofText("DivisionByZeroError");
+            if (op == "==") return SymbolValue::ofBoolean(leftNum == rightNum);
+            if (op == "!=") return SymbolValue::ofBoolean(leftNum != rightNum);
+            if (op == "<") return SymbolValue::ofBoolean(leftNum < rightNum);
+            if (op == ">") return SymbolValue::ofBoolean(leftNum > rightNum);
+            if (op == "<=") return SymbolValue::ofBoolean(leftNum <= rightNum);
+            if (op == ">=") return SymbolValue::ofBoolean(leftNum >= rightNum);
+            return getValueFromNode(node);
+        }
+
+        SymbolValue left = evaluateExpression(binOp->getLeft(), depth + 1);
+        SymbolValue right = evaluateExpression(binOp->getRight(), depth + 1);
 
         // Handle logical operators first
         if (op == "and") {
-            bool leftBool = (left == "True" || left == "1");
-            bool rightBool = (right == "True" || right == "1");
-            return (leftBool && rightBool) ? "True" : "False";
+            return SymbolValue::ofBoolean(isTruthy(left) && isTruthy(right));
         }
         else if (op == "or") {
-            bool leftBool = (left == "True" || left == "1");
-            bool rightBool = (right == "True" || right == "1");
-            return (leftBool || rightBool) ? "True" : "False";
-        }
-
-        // Then handle arithmetic operators
-        try {
-            double leftNum = stod(left);
-            double rightNum = stod(right);
-
-            if (op == "+") return to_string(leftNum + rightNum);
-            if (op == "-") return to_string(leftNum - rightNum);
-            if (op == "*") return to_string(leftNum * rightNum);
-            if (op == "/") {
-                if (rightNum == 0) return "DivisionByZeroError";
-                return to_string(leftNum / rightNum);
-            }
-            if (op == "%") return to_string((int)leftNum % (int)rightNum);
-            if (op == "==") return (leftNum == rightNum) ? "True" : "False";
-            if (op == "!=") return (leftNum != rightNum) ? "True" : "False";
-            if (op == "<") return (leftNum < rightNum) ? "True" : "False";
-            if (op == ">") return (leftNum > rightNum) ? "True" : "False";
-            if (op == "<=") return (leftNum <= rightNum) ? "True" : "False";
-            if (op == ">=") return (leftNum >= rightNum) ? "True" : "False";
-        } catch (...) {
-            // If conversion fails, return symbolic expression
-            return left + " " + op + " " + right;
+            return SymbolValue::ofBoolean(isTruthy(left) || isTruthy(right));
         }
+
+        // Some operand is not a number: return symbolic expression
+        return symbolTable.store(left.toString() + " " + string(op) + " " + right.toString());
     }
     // Handle unary operations
-    else if (auto unOp = dynamic_cast<UnaryOpNode*>(node)) {
-        string operand = evaluateExpression(unOp->getOperand());
-        string op = unOp->getOp().value;
+    case NodeKind::UnaryOp: {
+        auto unOp = static_cast<UnaryOpNode*>(node);
+        SymbolValue operand = evaluateExpression(unOp->getOperand(), depth + 1);
+        string_view op = text(unOp);
 
         if (op == "not") {
-            bool operandBool = (operand == "True" || operand == "1");
-            return (!operandBool) ? "True" : "False";
+            return SymbolValue::ofBoolean(!isTruthy(operand));
         }
 
-        try {
-            double num = stod(operand);
-            if (op == "-") return to_string(-num);
-            if (op == "+") return operand; // Unary plus doesn't change value
-        } catch (...) {
-            return op + " " + operand;
-        }
+        return symbolTable.store(string(op) + " " + operand.toString());
     }
     // Handle identifiers by looking up their value in symbol table
-    else if (auto idNode = dynamic_cast<IdentifierNode*>(node)) {
-        auto entry = symbolTable.lookupEntry(idNode->getToken().value);
+    case NodeKind::Identifier: {
+        auto entry = symbolTable.lookupEntry(symbolOf(node));
         if (entry) {
             // Convert common boolean representations
-            if (entry->value == "true") return "True";
-            if (entry->value == "false") return "False";
+            if (entry->value.textView() == "true") return SymbolValue::ofBoolean(true);
+            if (entry->value.textView() == "false") return SymbolValue::ofBoolean(false);
             return entry->value;
         }
-        return idNode->getToken().value;
+        return SymbolValue::ofText(text(node));
     }
     // Handle boolean literals directly
-    else if (auto boolNode = dynamic_cast<BooleanNode*>(node)) {
-        return boolNode->getToken().value;
+    case NodeKind::Boolean:
+        return SymbolValue::ofBoolean(tokens.buffer().keyword(node->token) == Keyword::True);
+    default:
+        break;
     }
 
     // For other nodes, just return their value
     return getValueFromNode(node);
 }
-
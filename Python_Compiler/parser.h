@@ -2,17 +2,72 @@
 #define PARSER_H
 
 #include <QObject>
+#include <functional>
+#include <unordered_map>
 #include "AST_Node.h"
+#include "Operators.h"
 #include "ParserSymbolTable.h"
+#include "TokenStream.h"
 
 struct ParseError {
+    static constexpr uint32_t noToken = ~uint32_t(0);
+
     int line;
     int col;
     std::string message;
+    uint32_t token = noToken;  // index of the token it was reported at, if any
     ParseError(int l, int c, const std::string& msg)
         : line(l), col(c), message(msg) {}
+    ParseError(uint32_t token, const Token& at, const std::string& msg)
+        : line(at.line), col(at.column), message(msg), token(token) {}
+};
+
+// Where the statement loop over a body (the program, or a block) can be
+// picked up again: at the body's first token, and before each statement it
+// reached with no stray indentation open
+struct ResumePoint {
+    uint32_t token;
+    uint32_t children;  // statements of the body before it
+    uint32_t errors;    // errors reported before it
 };
 
+// A body as parsed, for IncrementalParser to parse part of it again
+struct BodyLayout {
+    int scope;           // the scope its statements declare in
+    uint32_t end;        // the token its loop stopped at: the closing Dedent, or EOF
+    uint32_t errorsEnd;  // errors reported by then
+    vector<ResumePoint> resume;
+};
+
+// By the body's ProgramNode or BlockNode
+using BodyLayouts = unordered_map<const ASTNode*, BodyLayout>;
+
+// Parses the function bodies a lazy parse skipped, each when
+// FunctionDefNode::getBody() first asks for it. A Parser given one with
+// skipBodies() moves past well-formed function bodies by indentation alone
+// and leaves them to it; so does each body it parses, for the functions in
+// it. A body's nodes go in this parser's arena, its declarations into the
+// function's scope, reopened, and its errors after those found so far.
+//
+// Declarations are made when a body is parsed. Until then the table has
+// only the function and its parameters, and the function's return type is
+// unknown to code after it that uses it. Bodies must be asked for one at a
+// time, while only the global scope of the table is open
+class BodyParser {
+public:
+    BodyParser(shared_ptr<const TokenBuffer> tokens, shared_ptr<ParserSymbolTable> symbols)
+        : tokens(move(tokens)), symbols(move(symbols)) {}
+
+    ASTNode* parse(const FunctionDefNode& function);
+
+    // Those of the parse that skipped the bodies, then those of each body
+    vector<ParseError> errors;
+
+private:
+    shared_ptr<const TokenBuffer> tokens;
+    shared_ptr<ParserSymbolTable> symbols;
+    unique_ptr<AstArena> arena = make_unique<AstArena>();
+};
 
 class Parser : public QObject
 {
@@ -20,87 +75,176 @@ class Parser : public QObject
 public:
 
 private:
-    vector<Token> tokens;
-    int currentTokenIndex = 0;
-    Token currentToken;
+    TokenStream tokens;
+    const Token* currentToken;  // at the stream's cursor; moved by advance()
+    TokenType previousType = TokenType::Newline;  // the token consumed before currentToken
     vector<ParseError> errors;
-    vector<int> indentStack;
+    unique_ptr<AstArena> arena = make_unique<AstArena>();  // handed over by parseProgram
+    BodyLayouts* layouts = nullptr;
+    BodyParser* bodies = nullptr;
+    bool keepTree = true;
     ParserSymbolTable& symbolTable;  // Reference to symbol table from lexer
+    size_t nestingLimit = defaultNestingLimit;
+
+    // What parseExpr() is inside of, waiting for an operand: a binary
+    // expression (at its first operand, or at the right one of op), a prefix
+    // operator, parentheses, or a call's arguments
+    struct ExprFrame {
+        enum class Step : uint8_t { Left, Right, Prefix, Parentheses, Arguments };
+        Step step;
+        Precedence min;         // Left, Right: as in precedence climbing
+        int ceiling;
+        OperatorKind op;        // Right
+        uint32_t token;         // Right, Prefix: the operator; Arguments: the function name
+        ASTNode* node;          // Left, Right: the expression so far
+        uint32_t arguments;     // Arguments: where its own start in exprArguments
+    };
+    vector<ExprFrame> exprStack;
+    vector<ASTNode*> exprArguments;
+
+    // parseExpr(), or parsePrimary() if primary
+    ASTNode* parseNested(bool primary);
+
+    DataType getTypeFromNode(ASTNode *node);
+
+    SymbolValue getValueFromNode(ASTNode *node);
+    // Both give up on the part of an expression deeper than nestingLimit
+    SymbolValue evaluateExpression(ASTNode *node, size_t depth = 0);
+    // Value of an arithmetic expression over literals and numeric variables,
+    // computed in doubles; false if any part is not a known number
+    bool numericValue(ASTNode *node, double &value, size_t depth = 0);
+    bool isValidStatementStart(string_view id);
+
+    // A node's token, looked up in the tokens read so far
+    string_view text(const ASTNode* node) const { return tokens.buffer().value(node->token); }
+    int symbolOf(const ASTNode* node) const { return tokens.buffer().symbolId(node->token); }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) { return arena->make<T>(forward<Args>(args)...); }
+public:
+    // How deep blocks, and the operands of an expression, may nest before
+    // it is reported. Expressions are parsed on a stack of their own and
+    // evaluation stops at the limit, so neither runs out of stack; the limit
+    // keeps trees in reach of code that walks them recursively
+    static constexpr size_t defaultNestingLimit = 1000;
 
-    string getValueFromNode(const unique_ptr<ASTNode>& node);
+    // Take symbol table as reference in constructor
+    // Tokens are pulled from the stream as parsing proceeds
+    explicit Parser(TokenStream tokens, ParserSymbolTable& symTab, QObject *parent = nullptr);
 
-    string getTypeFromNode(const unique_ptr<ASTNode>& node);
+    // Records the layout of every body parsed from now on in into
+    void keepLayouts(BodyLayouts& into) { layouts = &into; }
 
-    string getValueFromNode(ASTNode *node);
-    string evaluateExpression(ASTNode *node);
-    bool isValidStatementStart(const string& id);
-public:
-    // Take symbol table as reference in constructor
-    explicit Parser(vector<Token> tokens, ParserSymbolTable& symTab, QObject *parent = nullptr);
+    // Leaves function bodies to `to`, see BodyParser
+    void skipBodies(BodyParser& to) { bodies = &to; }
+
+    void setNestingLimit(size_t limit) { nestingLimit = limit; }
+
+    // Keeps only errors and declarations: parseProgram() frees each
+    // top-level statement's nodes, and releases its tokens from the stream,
+    // once the next one starts, and returns an empty program. Memory then
+    // stays that of the longest statement. Not with keepLayouts or skipBodies
+    void discardTree() { keepTree = false; }
 
-    ParserSymbolTable getSymbolTable(){
+    // Allocates nodes in into instead of an arena of its own, e.g. the one
+    // of an earlier parse of the same tokens; takeArena() gives it back
+    void useArena(unique_ptr<AstArena> into) { arena = move(into); }
+    unique_ptr<AstArena> takeArena() { return move(arena); }
+
+    const ParserSymbolTable& getSymbolTable() const {
         return symbolTable;
     }
 
-    vector<ParseError> getErrors(){
+    // Valid until the parser reports another error
+    Span<ParseError> getErrors() const {
         return errors;
     }
 
+    // Hands the errors over, leaving none
+    vector<ParseError> takeErrors() {
+        return move(errors);
+    }
 
-    Token advance();
 
-    void expectIndent(int expectedLevel);
+    void advance();
 
-    Token peek();
+    // Whether currentToken is the first of a line
+    bool atLineStart() const;
 
-    Token peekNextToken();
+    // The body after a compound statement's ':', from Newline Indent to
+    // Dedent. One nested deeper than the limit is reported and skipped
+    BlockNode* parseBlock();
 
-    bool match(TokenType type, const string& value = "");
+    // Moves past such a body, from its Indent to the Dedent that matches it,
+    // as parseBlock() would
+    void skipBlock();
 
-    void expect(TokenType type, const string& errorMsg, const string& value = "");
+    // Statements into parent's children until the Dedent closing them (not
+    // consumed) or EOF
+    void parseStatements(ASTNode* parent);
 
-    void synchronize();
+    // The loop of parseStatements from the cursor, which must be at one of
+    // the body's resume points, adding to statements and to layout if there
+    // is one. Returns true if it stopped early, before a statement at a
+    // token reusable accepted
+    bool parseStatementsUntil(vector<ASTNode*>& statements, BodyLayout* layout,
+                              const function<bool(uint32_t)>& reusable);
+
+    // Makes the declarations parsing statements (a program or a block, as
+    // parsed from this parser's tokens) made, in the same order, into this
+    // parser's table, evaluating the same expressions against it. For a
+    // tree parsed in parts, each into a table of its own, this gives the
+    // table a parse of the whole would have
+    void redeclare(ASTNode* statements);
 
-    unique_ptr<ProgramNode> parseProgram();
+    // The current token and the one after it; valid until the next advance()
+    const Token& peek();
 
+    const Token& peekNextToken();
 
-    unique_ptr<ASTNode> parseStmt();
+    bool match(TokenType type, const string& value = "");
 
-    unique_ptr<ASTNode> parseFuncCall();
+    void expect(TokenType type, const string& errorMsg, const string& value = "");
 
-    unique_ptr<ASTNode> parseAssignStmt();
+    bool match(Keyword keyword);
 
-    unique_ptr<ASTNode> parseReturnStmt();
+    void expect(Keyword keyword, const string& errorMsg);
 
-    unique_ptr<ASTNode> parseIfStmt();
+    void synchronize();
 
-    unique_ptr<ASTNode> parseElseStmt();
+    // Parses the whole input; call once. The tree is allocated in an arena
+    // that comes with it
+    Ast parseProgram();
 
-    unique_ptr<ASTNode> parseForStmt();
 
-    unique_ptr<ASTNode> parseWhileStmt();
+    ASTNode* parseStmt();
 
-    unique_ptr<ASTNode> parseFuncDef();
+    ASTNode* parseAssignStmt();
 
-    unique_ptr<ASTNode> parseFuncCallStmt();
+    ASTNode* parseReturnStmt();
 
-    unique_ptr<ASTNode> parseExpr();
+    ASTNode* parseIfStmt();
 
-    unique_ptr<ASTNode> parseLogicalOr();
+    ASTNode* parseElseStmt();
 
-    unique_ptr<ASTNode> parseLogicalAnd();
+    ASTNode* parseForStmt();
 
-    unique_ptr<ASTNode> parseEquality();
+    ASTNode* parseWhileStmt();
 
-    unique_ptr<ASTNode> parseRelational();
+    ASTNode* parseFuncDef();
 
-    unique_ptr<ASTNode> parseTerm();
+    ASTNode* parseFuncCallStmt();
 
-    unique_ptr<ASTNode> parseFactor();
+    // Binary operators by precedence climbing over operatorTable. What the
+    // expression is inside of is kept on exprStack, not the call stack, so
+    // input of any depth parses; past the nesting limit it is reported once
+    ASTNode* parseExpr();
 
-    unique_ptr<ASTNode> parseUnary();
+    // A literal, a name, a call or a parenthesized expression
+    ASTNode* parsePrimary();
 
-    unique_ptr<ASTNode> parsePrimary();
+    // A literal or a name, or nullptr after reporting what is there instead
+    ASTNode* parseAtom();
 
     void addError(int line, int col, const std::string& msg);
 